@@ -1,7 +1,24 @@
 
 
-conf="-g -O0"
-#conf=
+# ./build.sh [debug|release|pgo], debug is the default
+# release: optimized with link time optimization
+# pgo: release build that is first instrumented, trained with --pgo-train and then built again with the recorded profile
+target=${1:-debug}
+
+case $target in
+	debug)
+		conf="-g -O0"
+		defines="-D_DEBUG"
+		;;
+	release|pgo)
+		conf="-O2 -flto"
+		defines="-DNDEBUG"
+		;;
+	*)
+		echo "Unknown target $target, use debug, release or pgo"
+		exit 1
+		;;
+esac
 
 glfw_src_shared="context.c init.c input.c monitor.c platform.c vulkan.c window.c egl_context.c osmesa_context.c null_init.c null_monitor.c null_window.c null_joystick.c"
 
@@ -9,14 +26,45 @@ glfw_src_apple="cocoa_time.c posix_module.c posix_thread.c"
 glfw_src_other="posix_time.c posix_module.c posix_thread.c"
 
 glfw_src_cocoa="cocoa_init.m cocoa_joystick.m cocoa_monitor.m cocoa_window.m nsgl_context.m"
+glfw_src_x11="x11_init.c x11_monitor.c x11_window.c xkb_unicode.c glx_context.c posix_poll.c linux_joystick.c"
+
+if [ "$(uname)" = "Darwin" ]; then
+	glfw_platform="-D_GLFW_COCOA $glfw_src_apple $glfw_src_cocoa"
+	libs="-framework Cocoa -framework IOKit -framework OpenGL"
+else
+	glfw_platform="-D_GLFW_X11 $glfw_src_other $glfw_src_x11"
+	libs="-lGL -lX11 -ldl -lpthread -lm"
+	# The system linker may not understand the LLVM bitcode of -flto
+	if [ "$target" != "debug" ]; then
+		libs="$libs -fuse-ld=lld"
+	fi
+fi
 
 cd glfw/src
 echo Compiling GLFW
-clang -c $conf -D_GLFW_COCOA $glfw_src_shared $glfw_src_apple $glfw_src_cocoa
+clang -c $conf $glfw_platform $glfw_src_shared || exit 1
 cd ~-
 
+# $1: additional flags
+build_snake()
+{
+	clang++ $conf $1 -std=c++11 -Iglfw/include -Iglm $defines -DGL_SILENCE_DEPRECATION main.cpp glfw/src/*.o $libs
+}
+
+if [ "$target" = "pgo" ]; then
+	echo Compiling instrumented Snake3D
+	rm -rf pgo
+	build_snake "-fprofile-generate=pgo" || exit 1
+
+	echo Training Snake3D
+	./a.out --pgo-train || exit 1
+	llvm-profdata merge -output=pgo/snake3d.profdata pgo/*.profraw || exit 1
 
-echo Compiling and creating Snake3D
-clang++ $conf -std=c++11 -Iglfw/include -Iglm -D_DEBUG -DGL_SILENCE_DEPRECATION main.cpp glfw/src/*.o -framework Cocoa -framework IOKit -framework OpenGL
+	echo Compiling and creating Snake3D with the profile
+	build_snake "-fprofile-use=pgo/snake3d.profdata" || exit 1
+else
+	echo Compiling and creating Snake3D
+	build_snake || exit 1
+fi
 
 rm glfw/src/*.o
@@ -14,62 +14,126 @@
 #include <OpenGL/OpenGL.h>
 #endif
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <cerrno>
+#endif
+
 #include <array>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <random>
 #include <ctime>
-
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <deque>
+#include <initializer_list>
+#include <functional>
+#include <new>
+
+// Lock-free ring buffer for exactly one producer and one consumer thread, neither of them ever blocks.
+// The indices only grow and are published with release stores, so an element is completely written
+// before the other side can see it. Both sides keep a cached copy of the other index and only reload it
+// with an acquire load when the ring looks full or empty. Every index sits on its own cache line,
+// so a push does not invalidate the line the consumer reads from and vice versa.
 template<typename T, size_t C>
-class simple_queue
+class spsc_ring
 {
+	static_assert(C > 0 && (C & (C - 1)) == 0, "The capacity has to be a power of two.");
+
 public:
-	void push_back(const T &t)
+	constexpr static size_t CACHE_LINE_SIZE = 64;
+
+	// Producer only, returns false if the ring is full.
+	bool push(const T &t)
 	{
-		if (s >= C)
-			return;
+		size_t w = writeIndex.load(std::memory_order_relaxed);
+		if (w - cachedReadIndex == C)
+		{
+			cachedReadIndex = readIndex.load(std::memory_order_acquire);
+			if (w - cachedReadIndex == C)
+				return false;
+		}
 
-		elements[s++] = t;
+		elements[w & (C - 1)] = t;
+		writeIndex.store(w + 1, std::memory_order_release);
+		return true;
 	}
 
-	size_t size() const
+	// Consumer only, returns false if the ring is empty.
+	bool pop(T &t)
 	{
-		return s;
+		size_t r = readIndex.load(std::memory_order_relaxed);
+		if (r == cachedWriteIndex)
+		{
+			cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+			if (r == cachedWriteIndex)
+				return false;
+		}
+
+		t = elements[r & (C - 1)];
+		readIndex.store(r + 1, std::memory_order_release);
+		return true;
 	}
 
-	const T &operator[](size_t i) const
+	// Consumer only, appends everything that is in the ring to out and hands the space back with a single store.
+	size_t popAll(std::vector<T> &out)
 	{
-		return elements[i];
+		size_t r = readIndex.load(std::memory_order_relaxed);
+		cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+
+		size_t count = cachedWriteIndex - r;
+		for (size_t i = 0; i < count; ++i)
+			out.push_back(elements[(r + i) & (C - 1)]);
+
+		readIndex.store(cachedWriteIndex, std::memory_order_release);
+		return count;
 	}
 
-	T &operator[](size_t i)
+	// Only a snapshot, the producer may push at the same time.
+	size_t size() const
 	{
-		return elements[i];
+		return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
 	}
 
-	void clear()
+	constexpr size_t capacity() const
 	{
-		s = 0;
+		return C;
 	}
 
 private:
-	size_t s = 0;
-	std::array<T, C> elements;
+	// Written by the producer
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> writeIndex{ 0 };
+	size_t cachedReadIndex = 0;
+
+	// Written by the consumer
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> readIndex{ 0 };
+	size_t cachedWriteIndex = 0;
+
+	alignas(CACHE_LINE_SIZE) std::array<T, C> elements;
 };
 
 namespace Randomf
 {
-	static std::default_random_engine randomGenerator;
-
-	void seed()
-	{
-		randomGenerator.seed(static_cast<unsigned int>(time(0)));
-	}
-
-	int randomInt(int inclStart, int inclEnd)
+	int randomInt(std::default_random_engine &generator, int inclStart, int inclEnd)
 	{
 		std::uniform_int_distribution<int> range(inclStart, inclEnd);
-		return range(randomGenerator);
+		return range(generator);
 	}
 }
 
@@ -94,6 +158,9 @@ namespace ApplicationSettings
 	// Defines the minimum height of the created window.
 	constexpr int WINDOW_MIN_HEIGHT = 520;
 
+	// Defines how long before the estimated render start the low latency loop wakes up.
+	constexpr std::chrono::microseconds LOW_LATENCY_MARGIN{ 1000 };
+
 	// Evaluate defines
 #ifdef HIDE_CONSOLE
 #pragma comment( linker, "/subsystem:\"windows\" /entry:\"mainCRTStartup\"" )
@@ -143,891 +210,5741 @@ namespace Debug
 }
 #endif // DEBUG
 
-#pragma region EVENT_HPP
-struct WindowPositionEventArgs
-{
-	int xpos, ypos;
-};
-
-struct WindowSizeEventArgs
-{
-	int width, height;
-};
-
-struct WindowCloseEventArgs
-{
-
-};
-
-struct WindowRefreshEventArgs
-{
+#pragma region GLEXT_HPP
+// Only OpenGL 1.1 is exported by the system libraries on windows, everything newer is loaded at runtime.
+#ifdef _WIN32
+	#define GLEXT_APIENTRY __stdcall
+#else
+	#define GLEXT_APIENTRY
+#endif
 
-};
+#ifndef GL_ARRAY_BUFFER
+	#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_STREAM_DRAW
+	#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_STATIC_DRAW
+	#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef GL_FRAGMENT_SHADER
+	#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+	#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+	#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+	#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_R32UI
+	#define GL_R32UI 0x8236
+#endif
+#ifndef GL_TEXTURE_BUFFER
+	#define GL_TEXTURE_BUFFER 0x8C2A
+#endif
+#ifndef GL_TEXTURE_3D
+	#define GL_TEXTURE_3D 0x806F
+#endif
+#ifndef GL_R8UI
+	#define GL_R8UI 0x8232
+#endif
+#ifndef GL_RED_INTEGER
+	#define GL_RED_INTEGER 0x8D94
+#endif
+#ifndef GL_RGBA16F
+	#define GL_RGBA16F 0x881A
+#endif
+#ifndef GL_R16F
+	#define GL_R16F 0x822D
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+	#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_FRAMEBUFFER
+	#define GL_FRAMEBUFFER 0x8D40
+#endif
+#ifndef GL_RENDERBUFFER
+	#define GL_RENDERBUFFER 0x8D41
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE
+	#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+	#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_COLOR_ATTACHMENT1
+	#define GL_COLOR_ATTACHMENT1 0x8CE1
+#endif
+#ifndef GL_DEPTH_ATTACHMENT
+	#define GL_DEPTH_ATTACHMENT 0x8D00
+#endif
+#ifndef GL_TIME_ELAPSED
+	#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+	#define GL_QUERY_RESULT 0x8866
+#endif
 
-struct WindowFocusEventArgs
+namespace GLExt
 {
-	bool focused;
-};
+	typedef GLuint(GLEXT_APIENTRY *CreateShaderProc)(GLenum type);
+	typedef void(GLEXT_APIENTRY *ShaderSourceProc)(GLuint shader, GLsizei count, const char *const *string, const GLint *length);
+	typedef void(GLEXT_APIENTRY *CompileShaderProc)(GLuint shader);
+	typedef void(GLEXT_APIENTRY *GetShaderivProc)(GLuint shader, GLenum pname, GLint *params);
+	typedef void(GLEXT_APIENTRY *GetShaderInfoLogProc)(GLuint shader, GLsizei bufSize, GLsizei *length, char *infoLog);
+	typedef void(GLEXT_APIENTRY *DeleteShaderProc)(GLuint shader);
+	typedef GLuint(GLEXT_APIENTRY *CreateProgramProc)();
+	typedef void(GLEXT_APIENTRY *AttachShaderProc)(GLuint program, GLuint shader);
+	typedef void(GLEXT_APIENTRY *LinkProgramProc)(GLuint program);
+	typedef void(GLEXT_APIENTRY *GetProgramivProc)(GLuint program, GLenum pname, GLint *params);
+	typedef void(GLEXT_APIENTRY *GetProgramInfoLogProc)(GLuint program, GLsizei bufSize, GLsizei *length, char *infoLog);
+	typedef void(GLEXT_APIENTRY *UseProgramProc)(GLuint program);
+	typedef GLint(GLEXT_APIENTRY *GetUniformLocationProc)(GLuint program, const char *name);
+	typedef void(GLEXT_APIENTRY *Uniform1iProc)(GLint location, GLint v0);
+	typedef void(GLEXT_APIENTRY *Uniform1fProc)(GLint location, GLfloat v0);
+	typedef void(GLEXT_APIENTRY *Uniform3iProc)(GLint location, GLint v0, GLint v1, GLint v2);
+	typedef void(GLEXT_APIENTRY *Uniform4fProc)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+	typedef void(GLEXT_APIENTRY *Uniform3fvProc)(GLint location, GLsizei count, const GLfloat *value);
+	typedef void(GLEXT_APIENTRY *UniformMatrix4fvProc)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+	typedef void(GLEXT_APIENTRY *GenBuffersProc)(GLsizei n, GLuint *buffers);
+	typedef void(GLEXT_APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+	typedef void(GLEXT_APIENTRY *BufferDataProc)(GLenum target, std::ptrdiff_t size, const void *data, GLenum usage);
+	typedef void(GLEXT_APIENTRY *BufferSubDataProc)(GLenum target, std::ptrdiff_t offset, std::ptrdiff_t size, const void *data);
+	typedef void(GLEXT_APIENTRY *GenVertexArraysProc)(GLsizei n, GLuint *arrays);
+	typedef void(GLEXT_APIENTRY *BindVertexArrayProc)(GLuint array);
+	typedef void(GLEXT_APIENTRY *ActiveTextureProc)(GLenum texture);
+	typedef void(GLEXT_APIENTRY *TexBufferProc)(GLenum target, GLenum internalformat, GLuint buffer);
+	typedef void(GLEXT_APIENTRY *DrawArraysInstancedProc)(GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+	typedef void(GLEXT_APIENTRY *TexImage3DProc)(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels);
+	typedef void(GLEXT_APIENTRY *GenFramebuffersProc)(GLsizei n, GLuint *framebuffers);
+	typedef void(GLEXT_APIENTRY *BindFramebufferProc)(GLenum target, GLuint framebuffer);
+	typedef void(GLEXT_APIENTRY *FramebufferTexture2DProc)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+	typedef GLenum(GLEXT_APIENTRY *CheckFramebufferStatusProc)(GLenum target);
+	typedef void(GLEXT_APIENTRY *GenRenderbuffersProc)(GLsizei n, GLuint *renderbuffers);
+	typedef void(GLEXT_APIENTRY *BindRenderbufferProc)(GLenum target, GLuint renderbuffer);
+	typedef void(GLEXT_APIENTRY *RenderbufferStorageProc)(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+	typedef void(GLEXT_APIENTRY *FramebufferRenderbufferProc)(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+	typedef void(GLEXT_APIENTRY *DrawBuffersProc)(GLsizei n, const GLenum *bufs);
+	typedef void(GLEXT_APIENTRY *BindFragDataLocationProc)(GLuint program, GLuint color, const char *name);
+	typedef void(GLEXT_APIENTRY *GenQueriesProc)(GLsizei n, GLuint *ids);
+	typedef void(GLEXT_APIENTRY *DeleteQueriesProc)(GLsizei n, const GLuint *ids);
+	typedef void(GLEXT_APIENTRY *BeginQueryProc)(GLenum target, GLuint id);
+	typedef void(GLEXT_APIENTRY *EndQueryProc)(GLenum target);
+	typedef void(GLEXT_APIENTRY *GetQueryObjectui64vProc)(GLuint id, GLenum pname, uint64_t *params);
+	typedef void(GLEXT_APIENTRY *TexSubImage3DProc)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels);
+
+	CreateShaderProc CreateShader = nullptr;
+	ShaderSourceProc ShaderSource = nullptr;
+	CompileShaderProc CompileShader = nullptr;
+	GetShaderivProc GetShaderiv = nullptr;
+	GetShaderInfoLogProc GetShaderInfoLog = nullptr;
+	DeleteShaderProc DeleteShader = nullptr;
+	CreateProgramProc CreateProgram = nullptr;
+	AttachShaderProc AttachShader = nullptr;
+	LinkProgramProc LinkProgram = nullptr;
+	GetProgramivProc GetProgramiv = nullptr;
+	GetProgramInfoLogProc GetProgramInfoLog = nullptr;
+	UseProgramProc UseProgram = nullptr;
+	GetUniformLocationProc GetUniformLocation = nullptr;
+	Uniform1iProc Uniform1i = nullptr;
+	Uniform1fProc Uniform1f = nullptr;
+	Uniform3iProc Uniform3i = nullptr;
+	Uniform4fProc Uniform4f = nullptr;
+	Uniform3fvProc Uniform3fv = nullptr;
+	UniformMatrix4fvProc UniformMatrix4fv = nullptr;
+	GenBuffersProc GenBuffers = nullptr;
+	BindBufferProc BindBuffer = nullptr;
+	BufferDataProc BufferData = nullptr;
+	BufferSubDataProc BufferSubData = nullptr;
+	GenVertexArraysProc GenVertexArrays = nullptr;
+	BindVertexArrayProc BindVertexArray = nullptr;
+	ActiveTextureProc ActiveTexture = nullptr;
+	TexBufferProc TexBuffer = nullptr;
+	DrawArraysInstancedProc DrawArraysInstanced = nullptr;
+	TexImage3DProc TexImage3D = nullptr;
+	TexSubImage3DProc TexSubImage3D = nullptr;
+	GenFramebuffersProc GenFramebuffers = nullptr;
+	BindFramebufferProc BindFramebuffer = nullptr;
+	FramebufferTexture2DProc FramebufferTexture2D = nullptr;
+	CheckFramebufferStatusProc CheckFramebufferStatus = nullptr;
+	GenRenderbuffersProc GenRenderbuffers = nullptr;
+	BindRenderbufferProc BindRenderbuffer = nullptr;
+	RenderbufferStorageProc RenderbufferStorage = nullptr;
+	FramebufferRenderbufferProc FramebufferRenderbuffer = nullptr;
+	DrawBuffersProc DrawBuffers = nullptr;
+	BindFragDataLocationProc BindFragDataLocation = nullptr;
+
+	// Optional, GL_TIME_ELAPSED queries need OpenGL 3.3 or ARB_timer_query
+	bool timerQueries = false;
+	GenQueriesProc GenQueries = nullptr;
+	DeleteQueriesProc DeleteQueries = nullptr;
+	BeginQueryProc BeginQuery = nullptr;
+	EndQueryProc EndQuery = nullptr;
+	GetQueryObjectui64vProc GetQueryObjectui64v = nullptr;
 
-struct WindowIconifyEventArgs
-{
-	bool iconified;
-};
+	template<typename T>
+	bool loadProc(T &proc, const char *name)
+	{
+		proc = reinterpret_cast<T>(glfwGetProcAddress(name));
+		if (proc == nullptr)
+			Debug::cerr("Missing OpenGL function ", name, ".\n");
+		return proc != nullptr;
+	}
 
-struct FramebufferSizeEventArgs
-{
-	int width, height;
-};
+	// Loads everything needed for the shader based render paths, requires a current OpenGL 3.1 context.
+	bool load(GLFWwindow *window)
+	{
+		int major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
+		int minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
+		if (major < 3 || (major == 3 && minor < 1))
+		{
+			Debug::clog("OpenGL ", major, '.', minor, " context, shader based render paths are disabled.\n");
+			return false;
+		}
 
-struct MouseButtonEventArgs
-{
-	int button, action, mods;
-};
+		bool loaded = true;
+		loaded &= loadProc(CreateShader, "glCreateShader");
+		loaded &= loadProc(ShaderSource, "glShaderSource");
+		loaded &= loadProc(CompileShader, "glCompileShader");
+		loaded &= loadProc(GetShaderiv, "glGetShaderiv");
+		loaded &= loadProc(GetShaderInfoLog, "glGetShaderInfoLog");
+		loaded &= loadProc(DeleteShader, "glDeleteShader");
+		loaded &= loadProc(CreateProgram, "glCreateProgram");
+		loaded &= loadProc(AttachShader, "glAttachShader");
+		loaded &= loadProc(LinkProgram, "glLinkProgram");
+		loaded &= loadProc(GetProgramiv, "glGetProgramiv");
+		loaded &= loadProc(GetProgramInfoLog, "glGetProgramInfoLog");
+		loaded &= loadProc(UseProgram, "glUseProgram");
+		loaded &= loadProc(GetUniformLocation, "glGetUniformLocation");
+		loaded &= loadProc(Uniform1i, "glUniform1i");
+		loaded &= loadProc(Uniform1f, "glUniform1f");
+		loaded &= loadProc(Uniform3i, "glUniform3i");
+		loaded &= loadProc(Uniform4f, "glUniform4f");
+		loaded &= loadProc(Uniform3fv, "glUniform3fv");
+		loaded &= loadProc(UniformMatrix4fv, "glUniformMatrix4fv");
+		loaded &= loadProc(GenBuffers, "glGenBuffers");
+		loaded &= loadProc(BindBuffer, "glBindBuffer");
+		loaded &= loadProc(BufferData, "glBufferData");
+		loaded &= loadProc(BufferSubData, "glBufferSubData");
+		loaded &= loadProc(GenVertexArrays, "glGenVertexArrays");
+		loaded &= loadProc(BindVertexArray, "glBindVertexArray");
+		loaded &= loadProc(ActiveTexture, "glActiveTexture");
+		loaded &= loadProc(TexBuffer, "glTexBuffer");
+		loaded &= loadProc(DrawArraysInstanced, "glDrawArraysInstanced");
+		loaded &= loadProc(TexImage3D, "glTexImage3D");
+		loaded &= loadProc(TexSubImage3D, "glTexSubImage3D");
+		loaded &= loadProc(GenFramebuffers, "glGenFramebuffers");
+		loaded &= loadProc(BindFramebuffer, "glBindFramebuffer");
+		loaded &= loadProc(FramebufferTexture2D, "glFramebufferTexture2D");
+		loaded &= loadProc(CheckFramebufferStatus, "glCheckFramebufferStatus");
+		loaded &= loadProc(GenRenderbuffers, "glGenRenderbuffers");
+		loaded &= loadProc(BindRenderbuffer, "glBindRenderbuffer");
+		loaded &= loadProc(RenderbufferStorage, "glRenderbufferStorage");
+		loaded &= loadProc(FramebufferRenderbuffer, "glFramebufferRenderbuffer");
+		loaded &= loadProc(DrawBuffers, "glDrawBuffers");
+		loaded &= loadProc(BindFragDataLocation, "glBindFragDataLocation");
+
+		if ((major > 3 || (major == 3 && minor >= 3)) || glfwExtensionSupported("GL_ARB_timer_query"))
+		{
+			timerQueries = loadProc(GenQueries, "glGenQueries");
+			timerQueries &= loadProc(DeleteQueries, "glDeleteQueries");
+			timerQueries &= loadProc(BeginQuery, "glBeginQuery");
+			timerQueries &= loadProc(EndQuery, "glEndQuery");
+			timerQueries &= loadProc(GetQueryObjectui64v, "glGetQueryObjectui64v");
+		}
+		return loaded;
+	}
 
-struct CursorPositionEventArgs
-{
-	double xpos, ypos;
-};
+	GLuint compileShader(GLenum type, const char *source)
+	{
+		GLuint shader = CreateShader(type);
+		ShaderSource(shader, 1, &source, nullptr);
+		CompileShader(shader);
 
-struct CursorEnterEventArgs
-{
-	bool entered;
-};
+		GLint status = GL_FALSE;
+		GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status == GL_FALSE)
+		{
+			std::array<char, 1024> log;
+			GetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), nullptr, log.data());
+			Debug::cerr("Error while compiling shader:\n", log.data(), '\n');
+			DeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
 
-struct MouseScrollWheelEventArgs
-{
-	double xoffset;
-	double yoffset;
-};
+	// Returns 0 if compiling or linking failed. Fragment outputs are bound to the draw buffers in the given order.
+	GLuint createProgram(const char *vertexSource, const char *fragmentSource, std::initializer_list<const char *> fragmentOutputs = {})
+	{
+		GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource);
+		GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+		if (vs == 0 || fs == 0)
+			return 0;
+
+		GLuint program = CreateProgram();
+		AttachShader(program, vs);
+		AttachShader(program, fs);
+		GLuint color = 0;
+		for (const char *output : fragmentOutputs)
+			BindFragDataLocation(program, color++, output);
+		LinkProgram(program);
+		DeleteShader(vs);
+		DeleteShader(fs);
+
+		GLint status = GL_FALSE;
+		GetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_FALSE)
+		{
+			std::array<char, 1024> log;
+			GetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+			Debug::cerr("Error while linking program:\n", log.data(), '\n');
+			return 0;
+		}
+		return program;
+	}
+}
+#pragma endregion
 
-struct KeyEventArgs
+#pragma region RENDER_STATS_HPP
+// Counts what every pass of a frame costs. The render code reports its draws, state changes and uploads,
+// RenderStats::lastFrame() returns the finished counters and an optional dump writes them as JSON lines.
+namespace RenderStats
 {
-	int key, scancode, action, mods;
-};
+	enum Pass
+	{
+		PASS_SCENE,
+		PASS_LINES,
+		PASS_VIEWS,
+		PASS_UI,
+		PASS_GHOSTS,
 
-struct CharEventArgs
-{
-	unsigned int codepoint;
-};
+		PASS_COUNT
+	};
 
-struct CharModsEventArgs
-{
-	unsigned int codepoint;
-	int mods;
-};
+	const char *PASS_NAMES[PASS_COUNT] = { "scene", "lines", "views", "ui", "ghosts" };
 
-struct Event
-{
-	enum Type
+	struct Counters
 	{
-		WindowPositionEvent,
-		WindowSizeEvent,
-		WindowCloseEvent,
-		WindowRefreshEvent,
-		WindowFocusEvent,
-		WindowIconifyEvent,
-		FramebufferSizeEvent,
-		MouseButtonEvent,
-		CursorPositionEvent,
-		MouseScrollWheelEvent,
-		KeyEvent,
-		CharEvent,
-		CharModsEvent,
+		uint64_t drawCalls = 0;
+		uint64_t vertices = 0;
+		uint64_t triangles = 0;
+		uint64_t stateChanges = 0;
+		uint64_t bytesUploaded = 0;
 
-		Count
+		Counters &operator+=(const Counters &other)
+		{
+			drawCalls += other.drawCalls;
+			vertices += other.vertices;
+			triangles += other.triangles;
+			stateChanges += other.stateChanges;
+			bytesUploaded += other.bytesUploaded;
+			return *this;
+		}
 	};
 
-	union
+	struct Frame
 	{
-		WindowPositionEventArgs windowPositionEventArgs;
-		WindowSizeEventArgs windowSizeEventArgs;
-		WindowCloseEventArgs windowCloseEventArgs;
-		WindowRefreshEventArgs windowRefreshEventArgs;
-		WindowFocusEventArgs windowFocusEventArgs;
-		WindowIconifyEventArgs windowIconifyEventArgs;
-		FramebufferSizeEventArgs framebufferSizeEventArgs;
-		MouseButtonEventArgs mouseButtonEventArgs;
-		CursorPositionEventArgs cursorPositionEventArgs;
-		CursorEnterEventArgs cursorEnterEventArgs;
-		MouseScrollWheelEventArgs mouseScrollWheelEventArgs;
-		KeyEventArgs keyEventArgs;
-		CharEventArgs charEventArgs;
-		CharModsEventArgs charModsEventArgs;
+		uint64_t index = 0;
+		double cpuTime = 0.0; // seconds from beginFrame to endFrame
+		std::array<Counters, PASS_COUNT> passes;
+
+		Counters total() const
+		{
+			Counters counters;
+			for (const Counters &pass : passes)
+				counters += pass;
+			return counters;
+		}
 	};
 
-	Type type;
-};
-#pragma endregion
+	// Only used by the render thread
+	Frame current;
+	Frame last;
+	Pass pass = PASS_SCENE;
+	double frameStart = 0.0;
 
-struct GLFWwindow;
-struct AppData
-{
-	int width = ApplicationSettings::WINDOW_MIN_WIDTH;
-	int height = ApplicationSettings::WINDOW_MIN_HEIGHT;
-	GLFWwindow *window = nullptr;
-	bool fullscreen = false;
-	bool showGameInformation = false;
-	simple_queue<Event, 1024> eventQueue;
-	std::mutex mutexEventQueue;
-	std::mutex initMutex;
+	GLenum immediateMode = GL_TRIANGLES;
+	uint64_t immediateVertices = 0;
 
-	bool initializationDone = false;
-	std::mutex initializationMutex;
-	std::condition_variable initializationCondition;
+	std::FILE *dumpFile = nullptr;
+	double dumpInterval = 1.0;
+	double dumpStart = 0.0;
+	Frame dumpSum;
+	uint64_t dumpFrames = 0;
 
-	AppData();
-	~AppData();
-};
+	uint64_t trianglesOf(GLenum mode, uint64_t vertices)
+	{
+		switch (mode)
+		{
+		case GL_TRIANGLES:
+			return vertices / 3;
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:
+			return vertices >= 3 ? vertices - 2 : 0;
+		default:
+			return 0;
+		}
+	}
 
-// Window events
-void windowPositionCallback(GLFWwindow *window, int xpos, int ypos);
-void windowSizeCallback(GLFWwindow *window, int width, int height);
-void windowCloseCallback(GLFWwindow *window);
-void windowRefreshCallback(GLFWwindow *window);
-void windowFocusCallback(GLFWwindow *window, int focused);
-void windowIconifyCallback(GLFWwindow *window, int minimized);
-void framebufferSizeCallback(GLFWwindow *window, int width, int height);
+	void beginPass(Pass p)
+	{
+		pass = p;
+	}
 
-// Input Events
-void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods);
-void cursorPositionCallback(GLFWwindow *window, double xpos, double ypos);
-void cursorEnterCallback(GLFWwindow *window, int entered);
-void scrollCallback(GLFWwindow *window, double xoffset, double yoffset);
-void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
-void charCallback(GLFWwindow *window, unsigned int codepoint);
-void charModsCallback(GLFWwindow *window, unsigned int codepoint, int mods);
+	void drawCall(GLenum mode, uint64_t vertices, uint64_t instances = 1)
+	{
+		Counters &c = current.passes[pass];
+		c.drawCalls += 1;
+		c.vertices += vertices * instances;
+		c.triangles += trianglesOf(mode, vertices) * instances;
+	}
 
-// Own events
-void onGlfwErrorEvent(int error, const char *description);
+	void stateChanges(uint64_t count = 1)
+	{
+		current.passes[pass].stateChanges += count;
+	}
 
-namespace su
-{
-	// Background
-	constexpr float BG_R = 0.05f;
-	constexpr float BG_G = 0.10f;
-	constexpr float BG_B = 0.15f;
+	void upload(uint64_t bytes)
+	{
+		current.passes[pass].bytesUploaded += bytes;
+	}
 
-	// Empty tile
-	constexpr float ET_R = BG_R * 0.7f;
-	constexpr float ET_G = BG_G * 0.7f;
-	constexpr float ET_B = BG_B * 0.7f;
+	// Render code changes GL state through these, so every change is counted where it happens.
+	void activeTexture(GLenum unit)
+	{
+		GLExt::ActiveTexture(unit);
+		stateChanges();
+	}
 
-	// Food tile
-	constexpr float FT_R = 0.8f;
-	constexpr float FT_G = 0.1f;
-	constexpr float FT_B = 0.1f;
+	void bindTexture(GLenum target, GLuint texture)
+	{
+		glBindTexture(target, texture);
+		stateChanges();
+	}
 
-	// Snake tile
-	constexpr float ST_R = 0.9f;
-	constexpr float ST_G = 1.0f;
-	constexpr float ST_B = 0.0f;
-}
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		GLExt::BindBuffer(target, buffer);
+		stateChanges();
+	}
 
-AppData::AppData()
-{
-	glfwSetErrorCallback(onGlfwErrorEvent);
+	void bindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		GLExt::BindFramebuffer(target, framebuffer);
+		stateChanges();
+	}
 
-	// GLFW
-	if (glfwInit() == GLFW_FALSE)
-		Debug::cerr("Error while initializing GLFW.\n");
-	else
-		Debug::clog("Using GLFW ", glfwGetVersionString(), '\n');
+	void bindRenderbuffer(GLenum target, GLuint renderbuffer)
+	{
+		GLExt::BindRenderbuffer(target, renderbuffer);
+		stateChanges();
+	}
 
-	// Window
-	glfwWindowHint(GLFW_SAMPLES, 4);
-	window = glfwCreateWindow(width, height, ApplicationSettings::NAME_STRING, nullptr, nullptr);
-	glfwSetWindowSizeLimits(window, ApplicationSettings::WINDOW_MIN_WIDTH, ApplicationSettings::WINDOW_MIN_HEIGHT, GLFW_DONT_CARE, GLFW_DONT_CARE);
-	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
-	glfwSetWindowUserPointer(window, this);
+	void bindVertexArray(GLuint vertexArray)
+	{
+		GLExt::BindVertexArray(vertexArray);
+		stateChanges();
+	}
 
-	// Window icon
-#ifndef __APPLE__
+	void useProgram(GLuint program)
 	{
-		constexpr size_t ICON_WIDTH = 16;
-		constexpr size_t ICON_HEIGHT = 16;
-		constexpr size_t ICON_DEPTH = 4;
+		GLExt::UseProgram(program);
+		stateChanges();
+	}
+
+	void enable(GLenum cap)
+	{
+		glEnable(cap);
+		stateChanges();
+	}
+
+	void disable(GLenum cap)
+	{
+		glDisable(cap);
+		stateChanges();
+	}
+
+	void cullFace(GLenum mode)
+	{
+		glCullFace(mode);
+		stateChanges();
+	}
+
+	void blendFunc(GLenum sfactor, GLenum dfactor)
+	{
+		glBlendFunc(sfactor, dfactor);
+		stateChanges();
+	}
+
+	void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+	{
+		glColorMask(red, green, blue, alpha);
+		stateChanges();
+	}
+
+	void depthMask(GLboolean flag)
+	{
+		glDepthMask(flag);
+		stateChanges();
+	}
+
+	void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+	{
+		glClearColor(red, green, blue, alpha);
+		stateChanges();
+	}
+
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		glViewport(x, y, width, height);
+		stateChanges();
+	}
+
+	void scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		glScissor(x, y, width, height);
+		stateChanges();
+	}
+
+	void matrixMode(GLenum mode)
+	{
+		glMatrixMode(mode);
+		stateChanges();
+	}
+
+	void loadMatrix(const GLfloat *m)
+	{
+		glLoadMatrixf(m);
+		stateChanges();
+	}
+
+	void loadIdentity()
+	{
+		glLoadIdentity();
+		stateChanges();
+	}
+
+	// glBegin/glEnd blocks count as one draw call, their vertex data as uploaded bytes.
+	void begin(GLenum mode)
+	{
+		glBegin(mode);
+		immediateMode = mode;
+		immediateVertices = 0;
+	}
+
+	void immediate(uint64_t vertices, uint64_t colors)
+	{
+		immediateVertices += vertices;
+		upload(vertices * 4 * sizeof(float) + colors * 4 * sizeof(float));
+	}
+
+	void end()
+	{
+		glEnd();
+		drawCall(immediateMode, immediateVertices);
+	}
+
+	// Starts writing one line per interval with the summed counters of all frames in that interval.
+	bool openDump(const char *path, double interval)
+	{
+		dumpFile = std::fopen(path, "w");
+		if (dumpFile == nullptr)
+		{
+			std::fprintf(stderr, "Could not open render stats file %s.\n", path);
+			return false;
+		}
+
+		dumpInterval = interval;
+		dumpStart = glfwGetTime();
+		return true;
+	}
+
+	void writeDump(double now)
+	{
+		std::fprintf(dumpFile, "{\"time\":%.6f,\"duration\":%.6f,\"frames\":%llu,\"cpu_time\":%.6f,\"passes\":{",
+			now, now - dumpStart, static_cast<unsigned long long>(dumpFrames), dumpSum.cpuTime);
+		for (size_t i = 0; i < PASS_COUNT; ++i)
+		{
+			const Counters &c = dumpSum.passes[i];
+			std::fprintf(dumpFile, "%s\"%s\":{\"draw_calls\":%llu,\"vertices\":%llu,\"triangles\":%llu,\"state_changes\":%llu,\"bytes_uploaded\":%llu}",
+				i == 0 ? "" : ",", PASS_NAMES[i],
+				static_cast<unsigned long long>(c.drawCalls), static_cast<unsigned long long>(c.vertices), static_cast<unsigned long long>(c.triangles),
+				static_cast<unsigned long long>(c.stateChanges), static_cast<unsigned long long>(c.bytesUploaded));
+		}
+		std::fprintf(dumpFile, "}}\n");
+		std::fflush(dumpFile);
+
+		dumpSum = Frame();
+		dumpFrames = 0;
+		dumpStart = now;
+	}
+
+	void closeDump()
+	{
+		if (dumpFile == nullptr)
+			return;
+
+		if (dumpFrames > 0)
+			writeDump(glfwGetTime());
+		std::fclose(dumpFile);
+		dumpFile = nullptr;
+	}
+
+	void beginFrame()
+	{
+		uint64_t index = current.index;
+		current = Frame();
+		current.index = index;
+		pass = PASS_SCENE;
+		frameStart = glfwGetTime();
+	}
+
+	void endFrame()
+	{
+		double now = glfwGetTime();
+		current.cpuTime = now - frameStart;
+		last = current;
+		++current.index;
+
+		if (dumpFile == nullptr)
+			return;
+
+		for (size_t i = 0; i < PASS_COUNT; ++i)
+			dumpSum.passes[i] += last.passes[i];
+		dumpSum.cpuTime += last.cpuTime;
+		++dumpFrames;
+
+		if (now - dumpStart >= dumpInterval)
+			writeDump(now);
+	}
+
+	// Counters of the last finished frame
+	const Frame &lastFrame()
+	{
+		return last;
+	}
+}
+#pragma endregion
+
+#pragma region THREAD_CONTROL_HPP
+// Pins threads to cores and raises their priority. Only Linux is supported, elsewhere the calls report that and do nothing.
+// Memory is placed by the kernel on the node of the core that first touches it, so threads are pinned before they
+// allocate their working set.
+namespace ThreadControl
+{
+	// Number of cpu ids that can be pinned to, ids have to be below it
+	long cpuIdLimit()
+	{
+#ifdef __linux__
+		long configured = sysconf(_SC_NPROCESSORS_CONF);
+		return configured > 0 && configured < CPU_SETSIZE ? configured : CPU_SETSIZE;
+#else
+		return 1024;
+#endif
+	}
+
+	// Parses lists like "0,2,4-7", returns false on malformed input and ids that do not exist
+	bool parseCpuList(const std::string &text, std::vector<int> &cpus)
+	{
+		cpus.clear();
+		long limit = cpuIdLimit();
+		size_t i = 0;
+		while (i < text.size())
+		{
+			size_t end = text.find(',', i);
+			if (end == std::string::npos)
+				end = text.size();
+
+			std::string range = text.substr(i, end - i);
+			size_t dash = range.find('-');
+			char *rest = nullptr;
+			long first = std::strtol(range.c_str(), &rest, 10);
+			long last = first;
+			if (rest == range.c_str())
+				return false;
+			if (dash != std::string::npos)
+			{
+				const char *lastText = range.c_str() + dash + 1;
+				last = std::strtol(lastText, &rest, 10);
+				if (rest == lastText)
+					return false;
+			}
+			if (*rest != '\0' || first < 0 || last < first)
+				return false;
+			if (last >= limit)
+			{
+				std::fprintf(stderr, "Cpu %ld does not exist, ids go up to %ld.\n", last, limit - 1);
+				return false;
+			}
+
+			for (long cpu = first; cpu <= last; ++cpu)
+				cpus.push_back(static_cast<int>(cpu));
+			i = end + 1;
+		}
+		return !cpus.empty();
+	}
+
+	// Restricts the calling thread to the given cores
+	bool pinCurrentThread(const std::vector<int> &cpus)
+	{
+		if (cpus.empty())
+			return true;
+
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : cpus)
+		{
+			if (cpu >= 0 && cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+		}
+
+		int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (error != 0)
+		{
+			std::fprintf(stderr, "Could not pin thread to cpu %d: %s\n", cpus.front(), std::strerror(error));
+			return false;
+		}
+		return true;
+#else
+		std::fprintf(stderr, "Thread pinning is not supported on this platform.\n");
+		return false;
+#endif
+	}
+
+	// Round robin pinning of thread index over cpus
+	bool pinCurrentThread(const std::vector<int> &cpus, size_t index)
+	{
+		if (cpus.empty())
+			return true;
+		return pinCurrentThread(std::vector<int>(1, cpus[index % cpus.size()]));
+	}
+
+	// Tries a round robin realtime policy first, that needs CAP_SYS_NICE, then a lower nice value
+	bool raiseCurrentThreadPriority()
+	{
+#ifdef __linux__
+		sched_param param = {};
+		param.sched_priority = sched_get_priority_min(SCHED_RR);
+		if (pthread_setschedparam(pthread_self(), SCHED_RR, &param) == 0)
+			return true;
+
+		pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+		if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid), -10) == 0)
+			return true;
+
+		std::fprintf(stderr, "Could not raise thread priority: %s\n", std::strerror(errno));
+		return false;
+#else
+		std::fprintf(stderr, "Raising thread priority is not supported on this platform.\n");
+		return false;
+#endif
+	}
+}
+#pragma endregion
+
+#pragma region LOCK_STATS_HPP
+// Drop-in replacement for std::mutex that counts acquisitions and contention and keeps wait and hold time histograms.
+// Works with std::lock_guard and std::unique_lock, waits need std::condition_variable_any.
+// Every mutex registers itself under a name, mutexes with the same name are reported together.
+namespace LockStats
+{
+	// Power of two buckets, bucket i counts durations below 2^(i + 6) ns, the last one everything longer
+	constexpr size_t BUCKET_COUNT = 24;
+
+	struct Histogram
+	{
+		std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets;
+
+		Histogram()
+		{
+			for (std::atomic<uint64_t> &bucket : buckets)
+				bucket.store(0, std::memory_order_relaxed);
+		}
+
+		static size_t bucketOf(int64_t ns)
+		{
+			size_t bucket = 0;
+			while (bucket + 1 < BUCKET_COUNT && ns >= (int64_t(1) << (bucket + 6)))
+				++bucket;
+			return bucket;
+		}
+
+		void add(int64_t ns)
+		{
+			buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	// Plain copy of a histogram that can be summed up
+	struct Summary
+	{
+		const char *name = nullptr;
+		uint64_t acquisitions = 0;
+		uint64_t contended = 0;
+		int64_t waitTime = 0; // ns
+		int64_t holdTime = 0; // ns
+		std::array<uint64_t, BUCKET_COUNT> wait{};
+		std::array<uint64_t, BUCKET_COUNT> hold{};
+
+		// Upper bound of the bucket the percentile falls into, in ns
+		static int64_t percentile(const std::array<uint64_t, BUCKET_COUNT> &buckets, double p)
+		{
+			uint64_t total = 0;
+			for (uint64_t count : buckets)
+				total += count;
+			if (total == 0)
+				return 0;
+
+			uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(total - 1)), seen = 0;
+			for (size_t i = 0; i < BUCKET_COUNT; ++i)
+			{
+				seen += buckets[i];
+				if (seen > rank)
+					return int64_t(1) << (i + 6);
+			}
+			return int64_t(1) << (BUCKET_COUNT + 5);
+		}
+	};
+
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	class InstrumentedMutex;
+
+	std::mutex registryMutex;
+	std::vector<InstrumentedMutex *> registry;
+
+	class InstrumentedMutex
+	{
+	public:
+		explicit InstrumentedMutex(const char *name)
+			: name(name)
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.push_back(this);
+		}
+
+		~InstrumentedMutex()
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.erase(std::find(registry.begin(), registry.end(), this));
+		}
+
+		InstrumentedMutex(const InstrumentedMutex &) = delete;
+		InstrumentedMutex &operator=(const InstrumentedMutex &) = delete;
+
+		void lock()
+		{
+			// Uncontended locks only pay for the try_lock and two clock reads
+			int64_t start = now();
+			if (!mutex.try_lock())
+			{
+				mutex.lock();
+				contended.fetch_add(1, std::memory_order_relaxed);
+			}
+			lockedAt = now();
+			acquired(lockedAt - start);
+		}
+
+		bool try_lock()
+		{
+			if (!mutex.try_lock())
+				return false;
+
+			lockedAt = now();
+			acquired(0);
+			return true;
+		}
+
+		void unlock()
+		{
+			int64_t held = now() - lockedAt;
+			holdTime.fetch_add(held, std::memory_order_relaxed);
+			hold.add(held);
+			mutex.unlock();
+		}
+
+		void addTo(Summary &summary) const
+		{
+			summary.name = name;
+			summary.acquisitions += acquisitions.load(std::memory_order_relaxed);
+			summary.contended += contended.load(std::memory_order_relaxed);
+			summary.waitTime += waitTime.load(std::memory_order_relaxed);
+			summary.holdTime += holdTime.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < BUCKET_COUNT; ++i)
+			{
+				summary.wait[i] += wait.buckets[i].load(std::memory_order_relaxed);
+				summary.hold[i] += hold.buckets[i].load(std::memory_order_relaxed);
+			}
+		}
+
+		const char *const name;
+
+	private:
+		std::mutex mutex;
+		int64_t lockedAt = 0; // only touched by the owner
+
+		std::atomic<uint64_t> acquisitions{ 0 };
+		std::atomic<uint64_t> contended{ 0 };
+		std::atomic<int64_t> waitTime{ 0 };
+		std::atomic<int64_t> holdTime{ 0 };
+		Histogram wait;
+		Histogram hold;
+
+		void acquired(int64_t waited)
+		{
+			acquisitions.fetch_add(1, std::memory_order_relaxed);
+			waitTime.fetch_add(waited, std::memory_order_relaxed);
+			wait.add(waited);
+		}
+	};
+
+	// One summary per mutex name, most contended first
+	std::vector<Summary> summaries()
+	{
+		std::vector<Summary> result;
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const InstrumentedMutex *mutex : registry)
+		{
+			auto it = std::find_if(result.begin(), result.end(), [&](const Summary &s) { return std::strcmp(s.name, mutex->name) == 0; });
+			if (it == result.end())
+			{
+				result.push_back(Summary());
+				it = result.end() - 1;
+			}
+			mutex->addTo(*it);
+		}
+
+		std::sort(result.begin(), result.end(), [](const Summary &a, const Summary &b)
+		{
+			return a.contended != b.contended ? a.contended > b.contended : a.waitTime > b.waitTime;
+		});
+		return result;
+	}
+
+	// Single line for the overlay, times in microseconds
+	std::string format(const Summary &s)
+	{
+		char line[160];
+		std::snprintf(line, sizeof(line), "%s %llu/%llu WAIT P99 %.1f HOLD P99 %.1f", s.name,
+			static_cast<unsigned long long>(s.contended), static_cast<unsigned long long>(s.acquisitions),
+			Summary::percentile(s.wait, 0.99) / 1000.0, Summary::percentile(s.hold, 0.99) / 1000.0);
+		return line;
+	}
+
+	void report()
+	{
+		for (const Summary &s : summaries())
+		{
+			if (s.acquisitions == 0)
+				continue;
+
+			std::fprintf(stderr, "Mutex %s: %llu locks, %llu contended, wait %lld us total (p50 < %lld ns, p99 < %lld ns), "
+				"hold %lld us total (p50 < %lld ns, p99 < %lld ns)\n", s.name,
+				static_cast<unsigned long long>(s.acquisitions), static_cast<unsigned long long>(s.contended),
+				static_cast<long long>(s.waitTime / 1000), static_cast<long long>(Summary::percentile(s.wait, 0.5)),
+				static_cast<long long>(Summary::percentile(s.wait, 0.99)), static_cast<long long>(s.holdTime / 1000),
+				static_cast<long long>(Summary::percentile(s.hold, 0.5)), static_cast<long long>(Summary::percentile(s.hold, 0.99)));
+		}
+	}
+}
+#pragma endregion
+
+#pragma region PROFILER_HPP
+// Scoped zones for the hot paths, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Compiled in with _DEBUG or SNAKE3D_PROFILE, otherwise PROFILE_ZONE expands to nothing like Debug::clog does.
+#if defined(_DEBUG) || defined(SNAKE3D_PROFILE)
+#define SNAKE3D_PROFILER
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the rest of the enclosing scope, name has to be a string literal
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+namespace Profiler
+{
+	constexpr size_t THREAD_BUFFER_SIZE = 16384; // zones per thread between two collects
+	constexpr size_t MAX_HISTORY = 1 << 20;       // zones kept for an export
+
+	struct Record
+	{
+		const char *name;
+		int64_t begin;
+		int64_t end;
+		uint32_t thread;
+	};
+
+	// steady_clock is clock_gettime(CLOCK_MONOTONIC) through the vDSO on Linux, cheap enough per zone
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	class ThreadBuffer;
+
+	LockStats::InstrumentedMutex registryMutex("profiler registry"); // guards everything below and the consumer side of every buffer
+	std::vector<ThreadBuffer *> buffers;
+	std::vector<std::string> threadNames;
+	std::vector<Record> history;
+	uint64_t dropped = 0;
+
+	// Zones of one thread, it only pushes into its ring and never locks after registering
+	class ThreadBuffer
+	{
+	public:
+		ThreadBuffer()
+		{
+			std::lock_guard<LockStats::InstrumentedMutex> lock(registryMutex);
+			id = static_cast<uint32_t>(threadNames.size());
+			threadNames.push_back("thread " + std::to_string(id));
+			buffers.push_back(this);
+		}
+
+		~ThreadBuffer()
+		{
+			std::lock_guard<LockStats::InstrumentedMutex> lock(registryMutex);
+			ring.popAll(history);
+			buffers.erase(std::find(buffers.begin(), buffers.end(), this));
+		}
+
+		void push(const char *name, int64_t begin, int64_t end)
+		{
+			if (!ring.push({ name, begin, end, id }))
+				++droppedZones;
+		}
+
+		uint32_t id;
+		spsc_ring<Record, THREAD_BUFFER_SIZE> ring;
+		std::atomic<uint64_t> droppedZones{ 0 };
+	};
+
+	ThreadBuffer &threadBuffer()
+	{
+		static thread_local ThreadBuffer buffer;
+		return buffer;
+	}
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char *name)
+			: name(name), begin(now())
+		{
+		}
+
+		~Zone()
+		{
+			threadBuffer().push(name, begin, now());
+		}
+
+		Zone(const Zone &) = delete;
+		Zone &operator=(const Zone &) = delete;
+
+	private:
+		const char *name;
+		int64_t begin;
+	};
+
+	// Names the calling thread in exported traces
+	void setThreadName(const std::string &name)
+	{
+		uint32_t id = threadBuffer().id;
+		std::lock_guard<LockStats::InstrumentedMutex> lock(registryMutex);
+		threadNames[id] = name;
+	}
+
+	void collectLocked()
+	{
+		for (ThreadBuffer *buffer : buffers)
+		{
+			buffer->ring.popAll(history);
+			dropped += buffer->droppedZones.exchange(0, std::memory_order_relaxed);
+		}
+
+		// Forget the older half instead of growing without bound
+		if (history.size() > MAX_HISTORY)
+			history.erase(history.begin(), history.begin() + (history.size() - MAX_HISTORY / 2));
+	}
+
+	// Moves the zones of every thread into the history, call regularly so the thread buffers do not fill up
+	void collect()
+	{
+		std::lock_guard<LockStats::InstrumentedMutex> lock(registryMutex);
+		collectLocked();
+	}
+
+	// Writes the collected zones as Chrome trace JSON, any thread
+	bool exportTrace(const char *path)
+	{
+		std::vector<Record> records;
+		std::vector<std::string> names;
+		uint64_t droppedZones;
+		{
+			std::lock_guard<LockStats::InstrumentedMutex> lock(registryMutex);
+			collectLocked();
+			records = history;
+			names = threadNames;
+			droppedZones = dropped;
+		}
+
+		FILE *file = std::fopen(path, "w");
+		if (file == nullptr)
+		{
+			std::fprintf(stderr, "Could not open profile %s.\n", path);
+			return false;
+		}
+
+		int64_t origin = records.empty() ? 0 : records.front().begin;
+		for (const Record &record : records)
+			origin = std::min(origin, record.begin);
+
+		std::fprintf(file, "{\"traceEvents\":[\n");
+		for (size_t i = 0; i < names.size(); ++i)
+			std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", i == 0 ? "" : ",\n",
+				static_cast<unsigned int>(i), names[i].c_str());
+		for (const Record &record : records)
+			std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				record.name, record.thread, (record.begin - origin) / 1000.0, (record.end - record.begin) / 1000.0);
+		std::fprintf(file, "\n]}\n");
+		std::fclose(file);
+
+		Debug::clog("Wrote ", records.size(), " profile zones to ", path, " (", droppedZones, " dropped).\n");
+		return true;
+	}
+}
+#else
+#define PROFILE_ZONE(name)
+
+namespace Profiler
+{
+	inline void setThreadName(const std::string &) { }
+	inline void collect() { }
+
+	inline bool exportTrace(const char *)
+	{
+		std::fprintf(stderr, "The profiler is not compiled in, build with -DSNAKE3D_PROFILE.\n");
+		return false;
+	}
+}
+#endif
+#pragma endregion
+
+#pragma region PERF_COUNTERS_HPP
+// Hardware counters (cycles, instructions, cache misses, branch misses) around the tick and frame sections of
+// mainThread, read with perf_event_open as one group so all four cover the same instructions. Only mainThread is
+// counted, scopes on other threads cost a thread_local check. Every interval the averages per call of every section
+// are written as a JSON line. Only available on Linux, perf_event_paranoid has to allow user space counting.
+namespace PerfCounters
+{
+	enum Section
+	{
+		SECTION_FRAME,
+		SECTION_TICK,
+		SECTION_SNAKE_UPDATE,
+		SECTION_NEW_FOOD,
+		SECTION_PASS_SCENE,
+		SECTION_PASS_GHOSTS,
+		SECTION_PASS_LINES,
+		SECTION_PASS_VIEWS,
+		SECTION_PASS_UI,
+
+		SECTION_COUNT
+	};
+
+	const char *SECTION_NAMES[SECTION_COUNT] = { "frame", "tick", "snake_update", "new_food", "pass_scene", "pass_ghosts", "pass_lines", "pass_views", "pass_ui" };
+
+	enum Counter
+	{
+		COUNTER_CYCLES,
+		COUNTER_INSTRUCTIONS,
+		COUNTER_CACHE_MISSES,
+		COUNTER_BRANCH_MISSES,
+
+		COUNTER_COUNT
+	};
+
+	const char *COUNTER_NAMES[COUNTER_COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+	struct Values
+	{
+		std::array<uint64_t, COUNTER_COUNT> counters{};
+	};
+
+	struct Totals
+	{
+		uint64_t calls = 0;
+		std::array<uint64_t, COUNTER_COUNT> counters{};
+	};
+
+#ifdef __linux__
+	class Group
+	{
+	public:
+		// Opens the counters for the calling thread, the ones the CPU or VM does not have stay unavailable
+		bool open()
+		{
+			const uint64_t configs[COUNTER_COUNT] = {
+				PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+			};
+
+			for (size_t i = 0; i < COUNTER_COUNT; ++i)
+			{
+				perf_event_attr attr;
+				std::memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[i];
+				attr.disabled = leader < 0 ? 1 : 0;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP;
+
+				int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+				if (fd < 0)
+				{
+					Debug::cerr("Counter ", COUNTER_NAMES[i], " is not available: ", std::strerror(errno), '\n');
+					continue;
+				}
+
+				if (leader < 0)
+					leader = fd;
+				else
+					fds.push_back(fd);
+				slots[i] = slotCount++;
+			}
+
+			if (leader < 0)
+				return false;
+
+			ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			return true;
+		}
+
+		~Group()
+		{
+			for (int fd : fds)
+				close(fd);
+			if (leader >= 0)
+				close(leader);
+		}
+
+		// One syscall for all counters of the group
+		Values read() const
+		{
+			struct
+			{
+				uint64_t count;
+				uint64_t values[COUNTER_COUNT];
+			} buffer = {};
+
+			Values values;
+			if (::read(leader, &buffer, sizeof(buffer)) <= 0)
+				return values;
+
+			for (size_t i = 0; i < COUNTER_COUNT; ++i)
+			{
+				if (slots[i] >= 0 && static_cast<uint64_t>(slots[i]) < buffer.count)
+					values.counters[i] = buffer.values[slots[i]];
+			}
+			return values;
+		}
+
+		bool available(size_t counter) const
+		{
+			return slots[counter] >= 0;
+		}
+
+	private:
+		int leader = -1;
+		std::vector<int> fds;
+		int slots[COUNTER_COUNT] = { -1, -1, -1, -1 };
+		int slotCount = 0;
+	};
+
+	thread_local Group *group = nullptr; // only set on the counted thread
+	std::unique_ptr<Group> ownedGroup;
+	std::array<Totals, SECTION_COUNT> totals;
+	FILE *file = nullptr;
+	double interval = 1.0;
+	std::chrono::steady_clock::time_point intervalStart;
+	Values frameBegin;
+
+	// Starts counting the calling thread and writing the averages to path every interval seconds
+	bool open(const char *path, double seconds)
+	{
+		ownedGroup.reset(new Group());
+		if (!ownedGroup->open())
+		{
+			std::fprintf(stderr, "Could not open any hardware counter, check /proc/sys/kernel/perf_event_paranoid.\n");
+			ownedGroup.reset();
+			return false;
+		}
+
+		file = std::fopen(path, "w");
+		if (file == nullptr)
+		{
+			std::fprintf(stderr, "Could not open perf counter file %s.\n", path);
+			ownedGroup.reset();
+			return false;
+		}
+
+		group = ownedGroup.get();
+		interval = seconds;
+		intervalStart = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	void write()
+	{
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - intervalStart).count();
+		std::fprintf(file, "{\"duration\":%.6f,\"sections\":{", seconds);
+		for (size_t s = 0; s < SECTION_COUNT; ++s)
+		{
+			const Totals &t = totals[s];
+			std::fprintf(file, "%s\"%s\":{\"calls\":%llu", s == 0 ? "" : ",", SECTION_NAMES[s], static_cast<unsigned long long>(t.calls));
+			for (size_t c = 0; c < COUNTER_COUNT; ++c)
+			{
+				if (group->available(c))
+					std::fprintf(file, ",\"%s\":%.1f", COUNTER_NAMES[c], t.calls > 0 ? static_cast<double>(t.counters[c]) / t.calls : 0.0);
+			}
+			if (group->available(COUNTER_CYCLES) && group->available(COUNTER_INSTRUCTIONS) && t.counters[COUNTER_CYCLES] > 0)
+				std::fprintf(file, ",\"ipc\":%.3f", static_cast<double>(t.counters[COUNTER_INSTRUCTIONS]) / t.counters[COUNTER_CYCLES]);
+			std::fprintf(file, "}");
+		}
+		std::fprintf(file, "}}\n");
+		std::fflush(file);
+
+		totals = std::array<Totals, SECTION_COUNT>();
+		intervalStart = std::chrono::steady_clock::now();
+	}
+
+	void add(Section section, const Values &begin, const Values &end)
+	{
+		Totals &t = totals[section];
+		++t.calls;
+		for (size_t i = 0; i < COUNTER_COUNT; ++i)
+			t.counters[i] += end.counters[i] - begin.counters[i];
+	}
+
+	// Counted thread only, the frame section is not a scope because it spans the whole loop body
+	void beginFrame()
+	{
+		if (group != nullptr)
+			frameBegin = group->read();
+	}
+
+	// Counted thread only, writes a line once the interval is over
+	void endFrame()
+	{
+		if (group == nullptr)
+			return;
+
+		add(SECTION_FRAME, frameBegin, group->read());
+		if (std::chrono::duration<double>(std::chrono::steady_clock::now() - intervalStart).count() >= interval)
+			write();
+	}
+
+	void close()
+	{
+		if (file == nullptr)
+			return;
+
+		write();
+		std::fclose(file);
+		file = nullptr;
+		group = nullptr;
+		ownedGroup.reset();
+	}
+
+	// Adds the counters of its lifetime to a section
+	class Scope
+	{
+	public:
+		explicit Scope(Section section)
+			: section(section)
+		{
+			if (group != nullptr)
+				begin = group->read();
+		}
+
+		~Scope()
+		{
+			if (group == nullptr)
+				return;
+
+			add(section, begin, group->read());
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	private:
+		Section section;
+		Values begin;
+	};
+#else
+	inline bool open(const char *, double)
+	{
+		std::fprintf(stderr, "Hardware counters are only supported on Linux.\n");
+		return false;
+	}
+
+	inline void beginFrame() { }
+	inline void endFrame() { }
+	inline void close() { }
+
+	class Scope
+	{
+	public:
+		explicit Scope(Section) { }
+	};
+#endif
+}
+#pragma endregion
+
+#pragma region JOBS_HPP
+// Fixed pool of worker threads that run small jobs, so subsystems schedule work instead of starting their own threads.
+// Every worker owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom, idle workers steal from the top.
+// Threads outside the pool (mainThread, the GLFW thread) submit through a shared injection queue and help running jobs
+// while they wait for a counter. Without workers every job simply runs inline.
+// Jobs can also be sent to the mailbox of a given worker. Its owner takes them before anything else, so batches that
+// go to the same worker every time keep using the memory that worker first touched, others only steal them when idle.
+namespace Jobs
+{
+	// Number of started jobs that did not finish yet
+	struct Counter
+	{
+		std::atomic<int> pending{ 0 };
+
+		bool done() const
+		{
+			return pending.load(std::memory_order_acquire) == 0;
+		}
+	};
+
+	struct Job
+	{
+		std::function<void()> function;
+		Counter *counter;
+	};
+
+	// Chase-Lev deque with the memory orders of Le, Pop, Cohen and Zappa Nardelli (2013), fixed capacity.
+	class WorkStealingDeque
+	{
+	public:
+		constexpr static int64_t CAPACITY = 4096;
+
+		WorkStealingDeque()
+		{
+			for (std::atomic<Job *> &job : jobs)
+				job.store(nullptr, std::memory_order_relaxed);
+		}
+
+		// Owner only, returns false if the deque is full
+		bool push(Job *job)
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			int64_t t = top.load(std::memory_order_acquire);
+			if (b - t >= CAPACITY)
+				return false;
+
+			jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// Owner only, takes the newest job
+		Job *pop()
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+
+			Job *job = nullptr;
+			if (t <= b)
+			{
+				job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+				if (t == b)
+				{
+					// Last job, race the thieves for it
+					if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+						job = nullptr;
+					bottom.store(b + 1, std::memory_order_relaxed);
+				}
+			}
+			else
+				bottom.store(b + 1, std::memory_order_relaxed);
+			return job;
+		}
+
+		// Any thread, takes the oldest job
+		Job *steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+
+			Job *job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return nullptr;
+			return job;
+		}
+
+	private:
+		// Padded instead of aligned, C++11 new does not honour alignments above the one of max_align_t
+		std::atomic<int64_t> top{ 0 };
+		char topPadding[64];
+		std::atomic<int64_t> bottom{ 0 };
+		char bottomPadding[64];
+		std::array<std::atomic<Job *>, CAPACITY> jobs;
+	};
+
+	// Jobs for one worker, filled by any thread
+	struct Mailbox
+	{
+		LockStats::InstrumentedMutex mutex{ "jobs mailbox" };
+		std::deque<Job *> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkStealingDeque>> deques; // one per worker
+	std::vector<std::unique_ptr<Mailbox>> mailboxes;        // one per worker
+	std::vector<std::thread> workers;
+	thread_local int workerIndex = -1;
+
+	LockStats::InstrumentedMutex injectionMutex("jobs injection");
+	std::deque<Job *> injection;
+
+	constexpr int SPIN_COUNT = 64;
+	std::atomic<bool> stopping{ false };
+	std::atomic<int> queued{ 0 }; // submitted jobs nobody took yet
+	std::atomic<int> sleepers{ 0 };
+	LockStats::InstrumentedMutex sleepMutex("jobs sleep");
+	std::condition_variable_any sleepCondition;
+
+	size_t workerCount()
+	{
+		return workers.size();
+	}
+
+	void execute(Job *job)
+	{
+		job->function();
+		job->counter->pending.fetch_sub(1, std::memory_order_release);
+		delete job;
+	}
+
+	Job *takeFrom(Mailbox &mailbox)
+	{
+		std::lock_guard<LockStats::InstrumentedMutex> lock(mailbox.mutex);
+		if (mailbox.jobs.empty())
+			return nullptr;
+
+		Job *job = mailbox.jobs.front();
+		mailbox.jobs.pop_front();
+		return job;
+	}
+
+	// Mailboxes of other workers are only looked at when asked to, so their owners get the first chance
+	Job *take(bool otherMailboxes)
+	{
+		Job *job = nullptr;
+		if (workerIndex >= 0)
+		{
+			job = takeFrom(*mailboxes[workerIndex]);
+			if (job == nullptr)
+				job = deques[workerIndex]->pop();
+		}
+
+		if (job == nullptr)
+		{
+			std::lock_guard<LockStats::InstrumentedMutex> lock(injectionMutex);
+			if (!injection.empty())
+			{
+				job = injection.front();
+				injection.pop_front();
+			}
+		}
+
+		// Start at the right neighbour, so thieves spread over the deques
+		for (size_t i = 1; job == nullptr && i <= deques.size(); ++i)
+			job = deques[(workerIndex + i) % deques.size()]->steal();
+		for (size_t i = 1; otherMailboxes && job == nullptr && i <= mailboxes.size(); ++i)
+			job = takeFrom(*mailboxes[(workerIndex + i) % mailboxes.size()]);
+
+		if (job != nullptr)
+			queued.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	// Runs one waiting job on the calling thread, returns false if there was none
+	bool runOne(bool otherMailboxes = true)
+	{
+		Job *job = take(otherMailboxes);
+		if (job == nullptr)
+			return false;
+
+		execute(job);
+		return true;
+	}
+
+	void workerLoop(int index, std::vector<int> cpus)
+	{
+		// Before the first job, so everything the worker allocates lands on its node
+		ThreadControl::pinCurrentThread(cpus, static_cast<size_t>(index));
+		Profiler::setThreadName("worker " + std::to_string(index));
+		workerIndex = index;
+		while (!stopping.load(std::memory_order_relaxed))
+		{
+			if (runOne(false))
+				continue;
+
+			// Stay awake for a moment, jobs often come in bursts
+			bool found = false;
+			for (int spin = 0; spin < SPIN_COUNT && !found; ++spin)
+			{
+				std::this_thread::yield();
+				found = runOne(false);
+			}
+			if (found || runOne(true))
+				continue;
+
+			std::unique_lock<LockStats::InstrumentedMutex> lock(sleepMutex);
+			sleepers.fetch_add(1);
+			while (queued.load() == 0 && !stopping.load())
+				sleepCondition.wait(lock);
+			sleepers.fetch_sub(1);
+		}
+	}
+
+	// Starts the pool, worker i is pinned to cpus[i % cpus.size()] if cpus are given.
+	// The calling thread does not become a worker.
+	void init(size_t count, const std::vector<int> &cpus = std::vector<int>())
+	{
+		stopping = false;
+		for (size_t i = 0; i < count; ++i)
+		{
+			deques.emplace_back(new WorkStealingDeque());
+			mailboxes.emplace_back(new Mailbox());
+		}
+		for (size_t i = 0; i < count; ++i)
+			workers.emplace_back(workerLoop, static_cast<int>(i), cpus);
+	}
+
+	// All jobs have to be finished
+	void shutdown()
+	{
+		{
+			std::lock_guard<LockStats::InstrumentedMutex> lock(sleepMutex);
+			stopping = true;
+		}
+		sleepCondition.notify_all();
+
+		for (std::thread &worker : workers)
+			worker.join();
+		workers.clear();
+		deques.clear();
+		mailboxes.clear();
+	}
+
+	void wake(bool all)
+	{
+		// A worker that is about to sleep either sees the job or is counted as sleeper here
+		if (sleepers.load() > 0)
+		{
+			{
+				std::lock_guard<LockStats::InstrumentedMutex> lock(sleepMutex);
+			}
+			if (all)
+				sleepCondition.notify_all();
+			else
+				sleepCondition.notify_one();
+		}
+	}
+
+	// Schedules function, counter is done once it and every other job started with it finished
+	void run(Counter &counter, std::function<void()> function)
+	{
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+		Job *job = new Job{ std::move(function), &counter };
+		if (workers.empty())
+		{
+			execute(job);
+			return;
+		}
+
+		queued.fetch_add(1);
+		if (workerIndex < 0 || !deques[workerIndex]->push(job))
+		{
+			std::lock_guard<LockStats::InstrumentedMutex> lock(injectionMutex);
+			injection.push_back(job);
+		}
+		wake(false);
+	}
+
+	// Schedules function on worker % workerCount() if nobody else is idle
+	void runOn(size_t worker, Counter &counter, std::function<void()> function)
+	{
+		if (workers.empty())
+		{
+			run(counter, std::move(function));
+			return;
+		}
+
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+		Job *job = new Job{ std::move(function), &counter };
+		queued.fetch_add(1);
+		{
+			Mailbox &mailbox = *mailboxes[worker % mailboxes.size()];
+			std::lock_guard<LockStats::InstrumentedMutex> lock(mailbox.mutex);
+			mailbox.jobs.push_back(job);
+		}
+		// The one woken up might not be the owner
+		wake(true);
+	}
+
+	// Helps running jobs until counter is done
+	void wait(const Counter &counter)
+	{
+		int idle = 0;
+		while (!counter.done())
+		{
+			if (runOne(idle >= SPIN_COUNT))
+				idle = 0;
+			else
+			{
+				++idle;
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Schedules function once dependency is done, waiting inside the job helps with other jobs meanwhile
+	void run(Counter &counter, std::function<void()> function, const Counter &dependency)
+	{
+		const Counter *d = &dependency;
+		run(counter, [d, function]()
+		{
+			wait(*d);
+			function();
+		});
+	}
+
+	// Calls function(begin, end) for batches of [0, count) in parallel and waits for all of them.
+	// With affine set, batch n always goes to worker n % workerCount(), so memory a batch touched stays local.
+	void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)> &function, bool affine = false)
+	{
+		Counter counter;
+		for (size_t begin = 0; begin < count; begin += batchSize)
+		{
+			size_t end = std::min(count, begin + batchSize);
+			auto batch = [&function, begin, end]()
+			{
+				function(begin, end);
+			};
+			if (affine)
+				runOn(begin / batchSize, counter, batch);
+			else
+				run(counter, batch);
+		}
+		wait(counter);
+	}
+}
+#pragma endregion
+
+#pragma region EVENT_HPP
+struct WindowPositionEventArgs
+{
+	int xpos, ypos;
+};
+
+struct WindowSizeEventArgs
+{
+	int width, height;
+};
+
+struct WindowCloseEventArgs
+{
+
+};
+
+struct WindowRefreshEventArgs
+{
+
+};
+
+struct WindowFocusEventArgs
+{
+	bool focused;
+};
+
+struct WindowIconifyEventArgs
+{
+	bool iconified;
+};
+
+struct FramebufferSizeEventArgs
+{
+	int width, height;
+};
+
+struct MouseButtonEventArgs
+{
+	int button, action, mods;
+};
+
+struct CursorPositionEventArgs
+{
+	double xpos, ypos;
+};
+
+struct CursorEnterEventArgs
+{
+	bool entered;
+};
+
+struct MouseScrollWheelEventArgs
+{
+	double xoffset;
+	double yoffset;
+};
+
+struct KeyEventArgs
+{
+	int key, scancode, action, mods;
+};
+
+struct CharEventArgs
+{
+	unsigned int codepoint;
+};
+
+struct CharModsEventArgs
+{
+	unsigned int codepoint;
+	int mods;
+};
+
+struct Event
+{
+	enum Type
+	{
+		WindowPositionEvent,
+		WindowSizeEvent,
+		WindowCloseEvent,
+		WindowRefreshEvent,
+		WindowFocusEvent,
+		WindowIconifyEvent,
+		FramebufferSizeEvent,
+		MouseButtonEvent,
+		CursorPositionEvent,
+		CursorEnterEvent,
+		MouseScrollWheelEvent,
+		KeyEvent,
+		CharEvent,
+		CharModsEvent,
+
+		Count
+	};
+
+	union
+	{
+		WindowPositionEventArgs windowPositionEventArgs;
+		WindowSizeEventArgs windowSizeEventArgs;
+		WindowCloseEventArgs windowCloseEventArgs;
+		WindowRefreshEventArgs windowRefreshEventArgs;
+		WindowFocusEventArgs windowFocusEventArgs;
+		WindowIconifyEventArgs windowIconifyEventArgs;
+		FramebufferSizeEventArgs framebufferSizeEventArgs;
+		MouseButtonEventArgs mouseButtonEventArgs;
+		CursorPositionEventArgs cursorPositionEventArgs;
+		CursorEnterEventArgs cursorEnterEventArgs;
+		MouseScrollWheelEventArgs mouseScrollWheelEventArgs;
+		KeyEventArgs keyEventArgs;
+		CharEventArgs charEventArgs;
+		CharModsEventArgs charModsEventArgs;
+	};
+
+	Type type;
+	int64_t timestamp; // Event::now() in the GLFW callback
+
+	// Monotonic nanoseconds, the clock of all event and tick times
+	static int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
+namespace EventTrace
+{
+	void recordEvent(const Event &e);
+}
+
+// Events from the GLFW callbacks (producer, main thread) to mainThread (consumer).
+// Events that only describe a state are coalesced on the producer side: each type has one pending slot that is
+// merged into and published when the GLFW event batch ends or right before the next event that is never coalesced,
+// which keeps e.g. the cursor position in order with mouse button presses.
+// When the ring is full, events wait in an overflow list that only the producer touches and move into the ring
+// in order with the next push or flush. Close, key and mouse button events are never dropped, the remaining
+// events are dropped once the overflow list is full as well. Pending slots keep merging while the ring is full and
+// move into the overflow list right before the next event that is never coalesced has to wait there.
+class EventQueue
+{
+public:
+	constexpr static size_t CAPACITY = 1024;
+	constexpr static size_t OVERFLOW_LIMIT = 256; // for events that may be dropped
+
+	enum class Coalesce
+	{
+		Never,
+		ReplaceLatest,  // absolute states, only the newest one matters
+		AccumulateDelta // relative changes, added up
+	};
+
+	struct Stats
+	{
+		size_t size;
+		size_t highWaterMark;
+		size_t drops;
+		size_t coalesces;
+	};
+
+	static Coalesce policy(Event::Type type)
+	{
+		switch (type)
+		{
+		case Event::Type::WindowPositionEvent:
+		case Event::Type::WindowSizeEvent:
+		case Event::Type::FramebufferSizeEvent:
+		case Event::Type::CursorPositionEvent: // absolute, the newest position already contains all motion deltas
+			return Coalesce::ReplaceLatest;
+		case Event::Type::MouseScrollWheelEvent:
+			return Coalesce::AccumulateDelta;
+		default:
+			return Coalesce::Never;
+		}
+	}
+
+	static bool isCritical(const Event &e)
+	{
+		return e.type == Event::Type::WindowCloseEvent || e.type == Event::Type::KeyEvent || e.type == Event::Type::MouseButtonEvent;
+	}
+
+	// Producer only
+	void push(const Event &e)
+	{
+		EventTrace::recordEvent(e);
+
+		Coalesce coalesce = policy(e.type);
+		if (coalesce != Coalesce::Never)
+		{
+			uint32_t bit = 1u << static_cast<uint32_t>(e.type);
+			Event &slot = pending[e.type];
+			if ((pendingMask & bit) == 0)
+			{
+				slot = e;
+				pendingMask |= bit;
+			}
+			else
+			{
+				if (coalesce == Coalesce::AccumulateDelta)
+				{
+					slot.mouseScrollWheelEventArgs.xoffset += e.mouseScrollWheelEventArgs.xoffset;
+					slot.mouseScrollWheelEventArgs.yoffset += e.mouseScrollWheelEventArgs.yoffset;
+				}
+				else
+					slot = e;
+				coalesces.fetch_add(1, std::memory_order_relaxed);
+			}
+			return;
+		}
+
+		flush();
+		if (overflow.empty() && ring.push(e))
+		{
+			updateHighWaterMark();
+			return;
+		}
+
+		if (!isCritical(e) && overflow.size() >= OVERFLOW_LIMIT)
+		{
+			drops.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		// The pending states came before e, so they wait in front of it, a click still sees the cursor position before it
+		for (uint32_t type = 0; pendingMask != 0 && type < Event::Type::Count; ++type)
+		{
+			uint32_t bit = 1u << type;
+			if ((pendingMask & bit) != 0)
+			{
+				overflow.push_back(pending[type]);
+				pendingMask &= ~bit;
+			}
+		}
+
+		overflow.push_back(e);
+		overflowPending.store(true, std::memory_order_release);
+		updateHighWaterMark();
+	}
+
+	// Producer only, publishes the pending slots and moves as many waiting events into the ring as fit.
+	void flush()
+	{
+		while (!overflow.empty() && ring.push(overflow.front()))
+			overflow.pop_front();
+
+		for (uint32_t type = 0; pendingMask != 0 && overflow.empty() && type < Event::Type::Count; ++type)
+		{
+			uint32_t bit = 1u << type;
+			if ((pendingMask & bit) != 0 && ring.push(pending[type]))
+				pendingMask &= ~bit;
+		}
+
+		overflowPending.store(!overflow.empty() || pendingMask != 0, std::memory_order_release);
+		updateHighWaterMark();
+	}
+
+	// Consumer only, replaces the content of batch with every published event. The events are handled from the
+	// batch afterwards, so the ring is free for the producer again while the consumer is still busy with them.
+	void drain(std::vector<Event> &batch)
+	{
+		batch.clear();
+		ring.popAll(batch);
+	}
+
+	// Consumer only, call after popping everything. The producer only flushes when it is woken up by a new event,
+	// so an empty event is posted while events are waiting.
+	void requestFlush()
+	{
+		if (overflowPending.load(std::memory_order_acquire))
+			glfwPostEmptyEvent();
+	}
+
+	// Any thread
+	Stats stats() const
+	{
+		return { ring.size(), highWaterMark.load(std::memory_order_relaxed), drops.load(std::memory_order_relaxed), coalesces.load(std::memory_order_relaxed) };
+	}
+
+private:
+	static_assert(Event::Type::Count <= 32, "The pending slots are tracked in a 32 bit mask.");
+
+	spsc_ring<Event, CAPACITY> ring;
+	std::deque<Event> overflow;
+	std::array<Event, Event::Type::Count> pending;
+	uint32_t pendingMask = 0;
+	std::atomic<bool> overflowPending{ false };
+
+	std::atomic<size_t> highWaterMark{ 0 };
+	std::atomic<size_t> drops{ 0 };
+	std::atomic<size_t> coalesces{ 0 };
+
+	void updateHighWaterMark()
+	{
+		size_t size = ring.size() + overflow.size();
+		if (size > highWaterMark.load(std::memory_order_relaxed))
+			highWaterMark.store(size, std::memory_order_relaxed);
+	}
+};
+#pragma endregion
+
+#pragma region EVENT_TRACE_HPP
+// Binary trace of every event plus tick and frame markers, for finding input hitches offline.
+// Producers copy fixed size records into lock-free rings (one per producer thread), a write job on the job workers
+// streams them to the file after every frame and every batch of window events. A full ring drops the record and
+// counts it, recording never blocks a callback or a frame.
+// The file is a header followed by raw Records in the byte order of the recording machine.
+namespace EventTrace
+{
+	constexpr char MAGIC[4] = { 'S', '3', 'D', 'T' };
+	constexpr uint32_t VERSION = 1;
+	constexpr size_t PAYLOAD_SIZE = 16;
+	constexpr size_t RING_SIZE = 8192;
+
+	enum Kind : uint8_t
+	{
+		KIND_EVENT,       // type and payload of the Event, timestamp from the callback
+		KIND_TICK,        // value is the tick number, payload the time the tick was due
+		KIND_FRAME_BEGIN, // value is the frame number
+		KIND_FRAME_END
+	};
+
+	struct Record
+	{
+		uint8_t kind;
+		uint8_t type;
+		uint8_t padding[6];
+		int64_t timestamp;
+		int64_t value;
+		uint8_t payload[PAYLOAD_SIZE];
+	};
+
+	static_assert(sizeof(Record) == 40, "Records are written as they are.");
+	static_assert(sizeof(KeyEventArgs) <= PAYLOAD_SIZE && sizeof(CursorPositionEventArgs) <= PAYLOAD_SIZE &&
+				  sizeof(MouseScrollWheelEventArgs) <= PAYLOAD_SIZE && sizeof(MouseButtonEventArgs) <= PAYLOAD_SIZE,
+				  "Event arguments do not fit into the payload.");
+
+	const char *EVENT_TYPE_NAMES[Event::Type::Count] = {
+		"WindowPosition", "WindowSize", "WindowClose", "WindowRefresh", "WindowFocus", "WindowIconify", "FramebufferSize",
+		"MouseButton", "CursorPosition", "CursorEnter", "MouseScrollWheel", "Key", "Char", "CharMods"
+	};
+
+	std::atomic<bool> recording{ false };
+	std::atomic<bool> writing{ false }; // a write job owns the consumer side of both rings
+	std::atomic<uint64_t> dropped{ 0 };
+	spsc_ring<Record, RING_SIZE> inputRing;  // produced by the GLFW callbacks
+	spsc_ring<Record, RING_SIZE> renderRing; // produced by mainThread
+	Jobs::Counter writeCounter;
+	std::vector<Record> writeBuffer;
+	FILE *file = nullptr;
+
+	void push(spsc_ring<Record, RING_SIZE> &ring, const Record &record)
+	{
+		if (!ring.push(record))
+			dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// GLFW callbacks only
+	void recordEvent(const Event &e)
+	{
+		if (!recording.load(std::memory_order_relaxed))
+			return;
+
+		Record record = {};
+		record.kind = KIND_EVENT;
+		record.type = static_cast<uint8_t>(e.type);
+		record.timestamp = e.timestamp;
+		std::memcpy(record.payload, &e.keyEventArgs, PAYLOAD_SIZE); // all arguments start at the same address
+		push(inputRing, record);
+	}
+
+	// mainThread only
+	void recordMarker(Kind kind, int64_t value, int64_t dueTime = 0)
+	{
+		if (!recording.load(std::memory_order_relaxed))
+			return;
+
+		Record record = {};
+		record.kind = kind;
+		record.timestamp = Event::now();
+		record.value = value;
+		std::memcpy(record.payload, &dueTime, sizeof(dueTime));
+		push(renderRing, record);
+	}
+
+	void write()
+	{
+		writeBuffer.clear();
+		inputRing.popAll(writeBuffer);
+		renderRing.popAll(writeBuffer);
+		if (!writeBuffer.empty())
+			std::fwrite(writeBuffer.data(), sizeof(Record), writeBuffer.size(), file);
+	}
+
+	// Any thread, schedules a job that streams the rings to the file unless one is still running
+	void flush()
+	{
+		if (!recording.load(std::memory_order_relaxed) || writing.exchange(true, std::memory_order_acquire))
+			return;
+
+		Jobs::run(writeCounter, []()
+		{
+			write();
+			writing.store(false, std::memory_order_release);
+		});
+	}
+
+	bool open(const char *path)
+	{
+		file = std::fopen(path, "wb");
+		if (file == nullptr)
+		{
+			std::fprintf(stderr, "Could not open event trace %s.\n", path);
+			return false;
+		}
+
+		std::fwrite(MAGIC, 1, sizeof(MAGIC), file);
+		std::fwrite(&VERSION, sizeof(VERSION), 1, file);
+
+		writeBuffer.reserve(2 * RING_SIZE);
+		recording = true;
+		return true;
+	}
+
+	// Call after the producers stopped
+	void close()
+	{
+		if (file == nullptr)
+			return;
+
+		recording = false;
+		Jobs::wait(writeCounter);
+		write();
+		std::fclose(file);
+		file = nullptr;
+
+		if (dropped > 0)
+			Debug::clog("Event trace dropped ", dropped.load(), " records.\n");
+	}
+
+	// Histogram with 1 ms buckets up to 50 ms, later ones go into the last bucket.
+	void printHistogram(const char *name, std::vector<double> &samples)
+	{
+		std::printf("%s: %u samples\n", name, static_cast<unsigned int>(samples.size()));
+		if (samples.empty())
+			return;
+
+		std::sort(samples.begin(), samples.end());
+		auto percentile = [&](double p)
+		{
+			return samples[static_cast<size_t>(p * (samples.size() - 1))];
+		};
+		std::printf("  min %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			samples.front(), percentile(0.5), percentile(0.95), percentile(0.99), samples.back());
+
+		constexpr size_t BUCKETS = 51;
+		std::array<size_t, BUCKETS> counts;
+		counts.fill(0);
+		for (double sample : samples)
+			++counts[std::min(static_cast<size_t>(sample), BUCKETS - 1)];
+
+		size_t most = *std::max_element(counts.begin(), counts.end());
+		for (size_t i = 0; i < BUCKETS; ++i)
+		{
+			if (counts[i] == 0)
+				continue;
+
+			std::string bar(std::max<size_t>(1, counts[i] * 50 / most), '#');
+			std::printf("  %s%2u ms %8u %s\n", i == BUCKETS - 1 ? ">=" : "  ", static_cast<unsigned int>(i), static_cast<unsigned int>(counts[i]), bar.c_str());
+		}
+	}
+
+	// Prints latency histograms of a trace and writes it as Chrome trace JSON (chrome://tracing, Perfetto).
+	bool convert(const char *tracePath, const char *jsonPath)
+	{
+		FILE *in = std::fopen(tracePath, "rb");
+		if (in == nullptr)
+		{
+			std::fprintf(stderr, "Could not open %s.\n", tracePath);
+			return false;
+		}
+
+		char magic[4];
+		uint32_t version = 0;
+		if (std::fread(magic, 1, sizeof(magic), in) != sizeof(magic) || std::memcmp(magic, MAGIC, sizeof(magic)) != 0 ||
+			std::fread(&version, sizeof(version), 1, in) != 1 || version != VERSION)
+		{
+			std::fprintf(stderr, "%s is not a version %u event trace.\n", tracePath, VERSION);
+			std::fclose(in);
+			return false;
+		}
+
+		std::vector<Record> records;
+		Record record;
+		while (std::fread(&record, sizeof(record), 1, in) == 1)
+			records.push_back(record);
+		std::fclose(in);
+
+		// The rings are written interleaved
+		std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) { return a.timestamp < b.timestamp; });
+		if (records.empty())
+		{
+			std::fprintf(stderr, "%s contains no records.\n", tracePath);
+			return false;
+		}
+
+		// Key press until the first tick due after it was simulated, and until the next frame picked it up
+		std::vector<double> inputToTick, inputToFrame, frameTimes;
+		int64_t lastFrameBegin = 0;
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			const Record &r = records[i];
+			if (r.kind == KIND_FRAME_BEGIN)
+			{
+				if (lastFrameBegin != 0)
+					frameTimes.push_back((r.timestamp - lastFrameBegin) * 1e-6);
+				lastFrameBegin = r.timestamp;
+				continue;
+			}
+
+			if (r.kind != KIND_EVENT || r.type != Event::Type::KeyEvent)
+				continue;
+
+			KeyEventArgs key;
+			std::memcpy(&key, r.payload, sizeof(key));
+			if (key.action != GLFW_PRESS)
+				continue;
+
+			bool frameFound = false, tickFound = false;
+			for (size_t j = i + 1; j < records.size() && !(frameFound && tickFound); ++j)
+			{
+				const Record &next = records[j];
+				if (!frameFound && next.kind == KIND_FRAME_BEGIN)
+				{
+					inputToFrame.push_back((next.timestamp - r.timestamp) * 1e-6);
+					frameFound = true;
+				}
+
+				int64_t dueTime;
+				std::memcpy(&dueTime, next.payload, sizeof(dueTime));
+				if (!tickFound && next.kind == KIND_TICK && dueTime >= r.timestamp)
+				{
+					inputToTick.push_back((next.timestamp - r.timestamp) * 1e-6);
+					tickFound = true;
+				}
+			}
+		}
+
+		printHistogram("Key press to tick", inputToTick);
+		printHistogram("Key press to frame", inputToFrame);
+		printHistogram("Frame time", frameTimes);
+
+		FILE *out = std::fopen(jsonPath, "w");
+		if (out == nullptr)
+		{
+			std::fprintf(stderr, "Could not open %s.\n", jsonPath);
+			return false;
+		}
+
+		// Microseconds since the first record, thread 1 shows frames and ticks, thread 2 the events
+		int64_t origin = records.front().timestamp;
+		auto us = [&](int64_t t)
+		{
+			return (t - origin) / 1000.0;
+		};
+
+		std::fprintf(out, "{\"traceEvents\":[\n");
+		std::fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"mainThread\"}},\n");
+		std::fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GLFW callbacks\"}}");
+		for (const Record &r : records)
+		{
+			switch (r.kind)
+			{
+			case KIND_EVENT:
+			{
+				const char *name = r.type < Event::Type::Count ? EVENT_TYPE_NAMES[r.type] : "Unknown";
+				std::fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":2,\"ts\":%.3f", name, us(r.timestamp));
+				if (r.type == Event::Type::KeyEvent)
+				{
+					KeyEventArgs key;
+					std::memcpy(&key, r.payload, sizeof(key));
+					std::fprintf(out, ",\"args\":{\"key\":%d,\"action\":%d}", key.key, key.action);
+				}
+				std::fprintf(out, "}");
+			} break;
+			case KIND_TICK:
+				std::fprintf(out, ",\n{\"name\":\"tick %lld\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":1,\"ts\":%.3f}", static_cast<long long>(r.value), us(r.timestamp));
+				break;
+			case KIND_FRAME_BEGIN:
+				std::fprintf(out, ",\n{\"name\":\"frame\",\"ph\":\"B\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"index\":%lld}}", us(r.timestamp), static_cast<long long>(r.value));
+				break;
+			case KIND_FRAME_END:
+				std::fprintf(out, ",\n{\"name\":\"frame\",\"ph\":\"E\",\"pid\":1,\"tid\":1,\"ts\":%.3f}", us(r.timestamp));
+				break;
+			}
+		}
+		std::fprintf(out, "\n]}\n");
+		std::fclose(out);
+
+		std::printf("Wrote %u records to %s\n", static_cast<unsigned int>(records.size()), jsonPath);
+		return true;
+	}
+}
+#pragma endregion
+
+enum class PresentMode
+{
+	VSync,         // swap interval 1
+	AdaptiveVSync, // swap interval -1, tears instead of waiting a whole refresh when a frame is late
+	Uncapped,      // swap interval 0
+	Capped,        // swap interval 0, paced to LaunchOptions::fpsCap by the FrameLimiter
+
+	Count
+};
+
+const char *PRESENT_MODE_NAMES[static_cast<int>(PresentMode::Count)] = { "vsync", "adaptive", "uncapped", "capped" };
+
+// Every core except the ones of the GLFW thread and mainThread
+inline size_t defaultWorkerCount()
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	return cores > 3 ? cores - 2 : 1;
+}
+
+// Settings that can be changed from the command line, see parseLaunchOptions.
+struct LaunchOptions
+{
+	PresentMode presentMode = PresentMode::VSync; // --present <vsync|adaptive|uncapped|capped>
+	double fpsCap = 60.0;                         // --fps-cap <fps>, implies --present capped
+	bool lowLatency = false;                      // --low-latency
+	bool orthoViews = false;                      // --views
+	size_t players = 1;                           // --players <1-4>
+	size_t ghosts = 0;                            // --ghosts <count>
+
+	size_t workers = defaultWorkerCount();        // --workers <count>
+	std::vector<int> workerCpus;                  // --pin-workers <cpu list>
+	std::vector<int> renderCpus;                  // --pin-render <cpu list>, mainThread renders and simulates
+	bool highPriority = false;                    // --high-priority
+	double timeScale = 1.0;                       // --time-scale <factor>
+
+	const char *renderStatsPath = nullptr;  // --render-stats <file>
+	double renderStatsInterval = 1.0;       // --render-stats-interval <seconds>, also used by --perf-counters
+	const char *perfCountersPath = nullptr; // --perf-counters <file>
+	const char *profilePath = "profile.json"; // --profile <file>, written with F8
+	bool profileOnExit = false;               // set by --profile
+	const char *tracePath = nullptr;          // --trace <file>
+	const char *convertTracePath = nullptr;   // --convert-trace <trace> <json>
+	const char *convertJsonPath = nullptr;
+	bool pgoTrain = false;                    // --pgo-train
+	const char *benchRenderPath = nullptr;    // --bench-render <file>
+	size_t benchFrames = 600;                 // --bench-frames <count>, per scene and render path
+};
+
+bool parseLaunchOptions(int argc, char **argv, LaunchOptions &options);
+
+struct GLFWwindow;
+struct AppData
+{
+	std::atomic<int> width{ ApplicationSettings::WINDOW_MIN_WIDTH };   // written by windowSizeCallback
+	std::atomic<int> height{ ApplicationSettings::WINDOW_MIN_HEIGHT };
+	GLFWwindow *window = nullptr;
+	bool fullscreen = false;
+	bool showGameInformation = false;
+	LaunchOptions options;
+	std::atomic<int> refreshRate{ 60 };          // of the monitor the window is on, only queried on the main thread
+	EventQueue eventQueue; // GLFW callbacks on the main thread produce, mainThread consumes
+
+	bool initializationDone = false;
+	LockStats::InstrumentedMutex initializationMutex{ "initialization" };
+	std::condition_variable_any initializationCondition;
+
+	AppData(const LaunchOptions &options);
+	~AppData();
+};
+
+// Main thread only, refresh rate of the monitor the window overlaps most, the primary one if it overlaps none
+int windowRefreshRate(GLFWwindow *window);
+
+// Window events
+void windowPositionCallback(GLFWwindow *window, int xpos, int ypos);
+void windowSizeCallback(GLFWwindow *window, int width, int height);
+void windowCloseCallback(GLFWwindow *window);
+void windowRefreshCallback(GLFWwindow *window);
+void windowFocusCallback(GLFWwindow *window, int focused);
+void windowIconifyCallback(GLFWwindow *window, int minimized);
+void framebufferSizeCallback(GLFWwindow *window, int width, int height);
+
+// Input Events
+void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods);
+void cursorPositionCallback(GLFWwindow *window, double xpos, double ypos);
+void cursorEnterCallback(GLFWwindow *window, int entered);
+void scrollCallback(GLFWwindow *window, double xoffset, double yoffset);
+void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
+void charCallback(GLFWwindow *window, unsigned int codepoint);
+void charModsCallback(GLFWwindow *window, unsigned int codepoint, int mods);
+
+// Own events
+void onGlfwErrorEvent(int error, const char *description);
+
+namespace su
+{
+	// Background
+	constexpr float BG_R = 0.05f;
+	constexpr float BG_G = 0.10f;
+	constexpr float BG_B = 0.15f;
+
+	// Empty tile
+	constexpr float ET_R = BG_R * 0.7f;
+	constexpr float ET_G = BG_G * 0.7f;
+	constexpr float ET_B = BG_B * 0.7f;
+
+	// Food tile
+	constexpr float FT_R = 0.8f;
+	constexpr float FT_G = 0.1f;
+	constexpr float FT_B = 0.1f;
+
+	// Snake tile
+	constexpr float ST_R = 0.9f;
+	constexpr float ST_G = 1.0f;
+	constexpr float ST_B = 0.0f;
+
+	// Snake head tile
+	constexpr float HT_R = 1.0f;
+	constexpr float HT_G = 1.0f;
+	constexpr float HT_B = 0.45f;
+
+	// Obstacle tile
+	constexpr float OT_R = 0.45f;
+	constexpr float OT_G = 0.5f;
+	constexpr float OT_B = 0.55f;
+}
+
+AppData::AppData(const LaunchOptions &options)
+	: options(options)
+{
+	glfwSetErrorCallback(onGlfwErrorEvent);
+
+	// GLFW
+	if (glfwInit() == GLFW_FALSE)
+		Debug::cerr("Error while initializing GLFW.\n");
+	else
+		Debug::clog("Using GLFW ", glfwGetVersionString(), '\n');
+
+	// Window
+	glfwWindowHint(GLFW_SAMPLES, 4);
+	window = glfwCreateWindow(width, height, ApplicationSettings::NAME_STRING, nullptr, nullptr);
+	glfwSetWindowSizeLimits(window, ApplicationSettings::WINDOW_MIN_WIDTH, ApplicationSettings::WINDOW_MIN_HEIGHT, GLFW_DONT_CARE, GLFW_DONT_CARE);
+	refreshRate = windowRefreshRate(window);
+	glfwMakeContextCurrent(window);
+	glfwSetWindowUserPointer(window, this);
+
+	// Window icon
+#ifndef __APPLE__
+	{
+		constexpr size_t ICON_WIDTH = 16;
+		constexpr size_t ICON_HEIGHT = 16;
+		constexpr size_t ICON_DEPTH = 4;
 		std::array<unsigned char, ICON_WIDTH * ICON_HEIGHT * ICON_DEPTH> pixels;
 
-		constexpr size_t BD = 3;
-		constexpr size_t BDM = BD + 1;
+		constexpr size_t BD = 3;
+		constexpr size_t BDM = BD + 1;
+
+		GLFWimage icon{ static_cast<int>(ICON_WIDTH), static_cast<int>(ICON_HEIGHT), pixels.data() };
+
+		for (size_t y = 0; y < ICON_HEIGHT; ++y)
+		{
+			for (size_t x = 0; x < ICON_WIDTH; ++x)
+			{
+				unsigned char r, g, b;
+				if (x == BD || y == BD || x == ICON_WIDTH - BDM || y == ICON_HEIGHT - BDM)
+				{ // background
+					r = static_cast<unsigned char>(su::BG_R * 255);
+					g = static_cast<unsigned char>(su::BG_G * 255);
+					b = static_cast<unsigned char>(su::BG_B * 255);
+				}
+				else if (x < BD || y < BD || x > ICON_WIDTH - BDM || y > ICON_HEIGHT - BDM)
+				{ // empty tile
+					if (x < BD && (y > BD && y < ICON_HEIGHT - BDM))
+					{ // snake tile
+						r = static_cast<unsigned char>(su::ST_R * 255);
+						g = static_cast<unsigned char>(su::ST_G * 255);
+						b = static_cast<unsigned char>(su::ST_B * 255);
+					}
+					else if (x > ICON_WIDTH - BDM && (y > BD && y < ICON_HEIGHT - BDM))
+					{ // food tile
+						r = static_cast<unsigned char>(su::FT_R * 255);
+						g = static_cast<unsigned char>(su::FT_G * 255);
+						b = static_cast<unsigned char>(su::FT_B * 255);
+					}
+					else
+					{ // empty tile
+						r = static_cast<unsigned char>(su::ET_R * 255);
+						g = static_cast<unsigned char>(su::ET_G * 255);
+						b = static_cast<unsigned char>(su::ET_B * 255);
+					}
+				}
+				else
+				{ // snake tile
+					r = static_cast<unsigned char>(su::ST_R * 255);
+					g = static_cast<unsigned char>(su::ST_G * 255);
+					b = static_cast<unsigned char>(su::ST_B * 255);
+				}
+
+				size_t i = (y * ICON_WIDTH + x) * ICON_DEPTH;
+
+				pixels[i + 0] = r;
+				pixels[i + 1] = g;
+				pixels[i + 2] = b;
+				pixels[i + 3] = 255;
+			}
+		}
+
+		glfwSetWindowIcon(window, 1, &icon);
+	}
+#endif
+
+	// Set window callbacks
+	glfwSetWindowPosCallback(window, windowPositionCallback);
+	glfwSetWindowSizeCallback(window, windowSizeCallback);
+	glfwSetWindowCloseCallback(window, windowCloseCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+	glfwSetWindowFocusCallback(window, windowFocusCallback);
+	glfwSetWindowIconifyCallback(window, windowIconifyCallback);
+	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+
+	// Set input callbacks
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
+	glfwSetCursorPosCallback(window, cursorPositionCallback);
+	glfwSetCursorEnterCallback(window, cursorEnterCallback);
+	glfwSetScrollCallback(window, scrollCallback);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetCharCallback(window, charCallback);
+	glfwSetCharModsCallback(window, charModsCallback);
+
+	glfwMakeContextCurrent(0);
+}
+
+AppData::~AppData()
+{
+	// Window
+	glfwDestroyWindow(window);
+
+	// GLFW
+	glfwTerminate();
+}
+
+// Constants
+namespace su
+{
+	constexpr size_t FIELD_WIDTH = 8;
+	constexpr size_t FIELD_HEIGHT = 8;
+	constexpr size_t FIELD_DEPTH = 8;
+	constexpr size_t FIELD_SIZE = FIELD_WIDTH * FIELD_HEIGHT * FIELD_DEPTH;
+
+	constexpr float FIELD_WIDTH_F = static_cast<float>(FIELD_WIDTH);
+	constexpr float FIELD_HEIGHT_F = static_cast<float>(FIELD_HEIGHT);
+	constexpr float FIELD_DEPTH_F = static_cast<float>(FIELD_DEPTH);
+
+	constexpr float FIELD_WIDTH_FH = FIELD_WIDTH_F * 0.5f;
+	constexpr float FIELD_HEIGHT_FH = FIELD_HEIGHT_F * 0.5f;
+	constexpr float FIELD_DEPTH_FH = FIELD_DEPTH_F * 0.5f;
+
+	constexpr static float CUBE_SIZE = 0.8f;
+	constexpr static float CUBE_SIZE_H = CUBE_SIZE * 0.5f;
+	constexpr static float CUBE_DIST = 1.0f - CUBE_SIZE;
+	constexpr static float CUBE_DIST_H = CUBE_DIST * 0.5f;
+
+	glm::mat4 mvp;
+
+	inline glm::vec4 transformPosition4(const glm::vec4 &pos)
+	{
+		return static_cast<glm::vec4>(mvp * pos);
+	}
+
+	// Cell types a cube can have, cubes only store this index instead of a color.
+	enum Palette : uint8_t
+	{
+		PALETTE_EMPTY,
+		PALETTE_FOOD,
+		PALETTE_SNAKE,
+		PALETTE_HEAD,
+		PALETTE_TEXT,
+		PALETTE_OBSTACLE,
+		PALETTE_SNAKE_2,
+		PALETTE_SNAKE_3,
+		PALETTE_SNAKE_4,
+
+		PALETTE_COUNT
+	};
+
+	enum Face
+	{
+		FACE_TOP,
+		FACE_BOTTOM,
+		FACE_FRONT,
+		FACE_BACK,
+		FACE_RIGHT,
+		FACE_LEFT,
+
+		FACE_COUNT
+	};
+
+	constexpr float FACE_SHADES[FACE_COUNT] = { 0.9f, 0.4f, 0.85f, 0.45f, 0.8f, 0.5f };
+
+	const glm::vec3 PALETTE_COLORS[PALETTE_COUNT] = {
+		{ ET_R, ET_G, ET_B },
+		{ FT_R, FT_G, FT_B },
+		{ ST_R, ST_G, ST_B },
+		{ HT_R, HT_G, HT_B },
+		{ ST_R, ST_G, ST_B },
+		{ OT_R, OT_G, OT_B },
+		{ 0.1f, 0.8f, 1.0f }, // snake of player 2
+		{ 1.0f, 0.3f, 0.9f }, // snake of player 3
+		{ 0.3f, 1.0f, 0.4f }  // snake of player 4
+	};
+
+	using ShadedPalette = std::array<std::array<glm::vec3, FACE_COUNT>, PALETTE_COUNT>;
+
+	ShadedPalette computeShadedPalette()
+	{
+		ShadedPalette shaded;
+		for (size_t i = 0; i < PALETTE_COUNT; ++i)
+		{
+			for (size_t f = 0; f < FACE_COUNT; ++f)
+				shaded[i][f] = PALETTE_COLORS[i] * FACE_SHADES[f];
+		}
+		return shaded;
+	}
+
+	// Face colors of every palette entry, indexed by [palette][face]. Also uploaded to the shaders as is.
+	const ShadedPalette PALETTE_SHADES = computeShadedPalette();
+
+	void drawCube(const glm::vec3 &p, Palette palette)
+	{
+		glm::vec4 v0t = transformPosition4({ p.x - CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
+		glm::vec4 v1t = transformPosition4({ p.x + CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
+		glm::vec4 v2t = transformPosition4({ p.x + CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
+		glm::vec4 v3t = transformPosition4({ p.x - CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
+				
+		glm::vec4 v0b = transformPosition4({ p.x - CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
+		glm::vec4 v1b = transformPosition4({ p.x + CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
+		glm::vec4 v2b = transformPosition4({ p.x + CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
+		glm::vec4 v3b = transformPosition4({ p.x - CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
+
+		const std::array<glm::vec3, FACE_COUNT> &shades = PALETTE_SHADES[palette];
+		RenderStats::immediate(36, FACE_COUNT);
+
+		// Top tile
+		glColor3fv(&shades[FACE_TOP][0]);
+		glVertex4fv(&v0t[0]);
+		glVertex4fv(&v1t[0]);
+		glVertex4fv(&v2t[0]);
+
+		glVertex4fv(&v2t[0]);
+		glVertex4fv(&v3t[0]);
+		glVertex4fv(&v0t[0]);
+
+		// Bottom Tile
+		glColor3fv(&shades[FACE_BOTTOM][0]);
+		glVertex4fv(&v2b[0]);
+		glVertex4fv(&v1b[0]);
+		glVertex4fv(&v0b[0]);
+
+		glVertex4fv(&v0b[0]);
+		glVertex4fv(&v3b[0]);
+		glVertex4fv(&v2b[0]);
+
+		// Front tile
+		glColor3fv(&shades[FACE_FRONT][0]);
+		glVertex4fv(&v3t[0]);
+		glVertex4fv(&v2t[0]);
+		glVertex4fv(&v2b[0]);
+
+		glVertex4fv(&v2b[0]);
+		glVertex4fv(&v3b[0]);
+		glVertex4fv(&v3t[0]);
+
+		// Back tile
+		glColor3fv(&shades[FACE_BACK][0]);
+		glVertex4fv(&v1b[0]);
+		glVertex4fv(&v1t[0]);
+		glVertex4fv(&v0t[0]);
+
+		glVertex4fv(&v0t[0]);
+		glVertex4fv(&v0b[0]);
+		glVertex4fv(&v1b[0]);
+
+		// Right tile
+		glColor3fv(&shades[FACE_RIGHT][0]);
+		glVertex4fv(&v2t[0]);
+		glVertex4fv(&v1t[0]);
+		glVertex4fv(&v1b[0]);
+
+		glVertex4fv(&v1b[0]);
+		glVertex4fv(&v2b[0]);
+		glVertex4fv(&v2t[0]);
+
+		// Left tile
+		glColor3fv(&shades[FACE_LEFT][0]);
+		glVertex4fv(&v0b[0]);
+		glVertex4fv(&v0t[0]);
+		glVertex4fv(&v3t[0]);
+		
+		glVertex4fv(&v3t[0]);
+		glVertex4fv(&v3b[0]);
+		glVertex4fv(&v0b[0]);
+	}
+
+	enum class RenderPath
+	{
+		Immediate,     // display lists of drawCube, transformed by the fixed function pipeline
+		VertexPulling, // one instanced draw of the cube batch
+		Raymarch,      // one draw that raymarches the occupancy texture
+
+		Count
+	};
+
+	// Expands cubes in the vertex shader: gl_InstanceID selects the cube, gl_VertexID the corner.
+	// The only per cube data is a packed cell index and palette byte, fetched from a buffer texture.
+	namespace VertexPulling
+	{
+		const char *VERTEX_SHADER = R"(#version 140
+uniform mat4 uMvp;
+uniform ivec3 uGridSize;
+uniform float uCubeSizeH;
+uniform vec3 uPaletteShades[16 * 6];
+uniform usamplerBuffer uCubes;
+
+flat out vec3 vColor;
+
+// Same corners and winding as su::drawCube, faces: top, bottom, front, back, right, left
+const int CORNERS[36] = int[36](0, 1, 2, 2, 3, 0,  6, 5, 4, 4, 7, 6,  3, 2, 6, 6, 7, 3,  5, 1, 0, 0, 4, 5,  2, 1, 5, 5, 6, 2,  4, 0, 3, 3, 7, 4);
+const vec3 OFFSETS[8] = vec3[8](vec3(-1.0, 1.0, -1.0), vec3(1.0, 1.0, -1.0), vec3(1.0, 1.0, 1.0), vec3(-1.0, 1.0, 1.0),
+                                vec3(-1.0, -1.0, -1.0), vec3(1.0, -1.0, -1.0), vec3(1.0, -1.0, 1.0), vec3(-1.0, -1.0, 1.0));
+
+void main()
+{
+	uint cube = texelFetch(uCubes, gl_InstanceID).r;
+	int cell = int(cube & 0xFFFFFFu);
+	ivec3 p = ivec3(cell % uGridSize.x, (cell / uGridSize.x) % uGridSize.y, cell / (uGridSize.x * uGridSize.y));
+
+	vec3 center = vec3(p) + vec3(uCubeSizeH);
+	gl_Position = uMvp * vec4(center + OFFSETS[CORNERS[gl_VertexID]] * uCubeSizeH, 1.0);
+	vColor = uPaletteShades[int(cube >> 24u) * 6 + gl_VertexID / 6];
+}
+)";
+
+		const char *FRAGMENT_SHADER = R"(#version 140
+flat in vec3 vColor;
+
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = vec4(vColor, 1.0);
+}
+)";
+
+		constexpr size_t MAX_PALETTE_SIZE = 16;
+		static_assert(PALETTE_COUNT <= MAX_PALETTE_SIZE, "Palette does not fit into the shader uniform.");
+
+		bool available = false;
+		GLuint program = 0;
+		GLuint vertexArray = 0;
+
+		GLint uMvp = -1;
+		GLint uGridSize = -1;
+
+		// Requires GLExt::load to have succeeded.
+		void init()
+		{
+			program = GLExt::createProgram(VERTEX_SHADER, FRAGMENT_SHADER);
+			if (program == 0)
+				return;
+
+			uMvp = GLExt::GetUniformLocation(program, "uMvp");
+			uGridSize = GLExt::GetUniformLocation(program, "uGridSize");
+
+			GLExt::UseProgram(program);
+			GLExt::Uniform1i(GLExt::GetUniformLocation(program, "uCubes"), 0);
+			GLExt::Uniform1f(GLExt::GetUniformLocation(program, "uCubeSizeH"), CUBE_SIZE_H);
+			GLExt::Uniform3fv(GLExt::GetUniformLocation(program, "uPaletteShades"), PALETTE_COUNT * FACE_COUNT, &PALETTE_SHADES[0][0][0]);
+			GLExt::UseProgram(0);
+
+			// No vertex attributes are used, but drawing requires a bound vertex array
+			GLExt::GenVertexArrays(1, &vertexArray);
+
+			available = true;
+		}
+
+		// Draws count cubes from a buffer texture with su::mvp.
+		void draw(GLuint cubeTexture, size_t count, size_t gridWidth, size_t gridHeight, size_t gridDepth)
+		{
+			if (count == 0)
+				return;
+
+			RenderStats::activeTexture(GL_TEXTURE0);
+			RenderStats::bindTexture(GL_TEXTURE_BUFFER, cubeTexture);
+
+			RenderStats::useProgram(program);
+			GLExt::UniformMatrix4fv(uMvp, 1, GL_FALSE, &mvp[0][0]);
+			GLExt::Uniform3i(uGridSize, static_cast<GLint>(gridWidth), static_cast<GLint>(gridHeight), static_cast<GLint>(gridDepth));
+			RenderStats::upload(sizeof(mvp) + 3 * sizeof(GLint));
+
+			RenderStats::bindVertexArray(vertexArray);
+			GLExt::DrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(count));
+			RenderStats::bindVertexArray(0);
+			RenderStats::drawCall(GL_TRIANGLES, 36, count);
+
+			RenderStats::useProgram(0);
+			RenderStats::bindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+	}
+
+	// Collects cubes that are drawn together. Each cube is stored as a cell index in the lower 24 bits plus
+	// a palette byte, which is all the vertex pulling path needs (4 bytes per cube).
+	// The GPU copies (instance buffer or display list) are only updated after the cubes changed,
+	// drawing the same batch again, e.g. into another viewport, costs one draw call and no uploads.
+	class CubeBatch
+	{
+	public:
+		CubeBatch(size_t gridWidth, size_t gridHeight, size_t gridDepth)
+			: gridWidth(gridWidth), gridHeight(gridHeight), gridDepth(gridDepth)
+		{
+
+		}
+
+		CubeBatch(const CubeBatch &) = delete;
+		CubeBatch &operator=(const CubeBatch &) = delete;
+
+		void clear()
+		{
+			cubes.clear();
+			bufferDirty = true;
+			listDirty = true;
+		}
+
+		void add(const glm::vec3 &cell, Palette palette)
+		{
+			uint32_t x = static_cast<uint32_t>(cell.x);
+			uint32_t y = static_cast<uint32_t>(cell.y);
+			uint32_t z = static_cast<uint32_t>(cell.z);
+			uint32_t index = static_cast<uint32_t>(x + gridWidth * (y + gridHeight * z));
+
+			cubes.push_back(index | (static_cast<uint32_t>(palette) << 24));
+			bufferDirty = true;
+			listDirty = true;
+		}
+
+		size_t size() const
+		{
+			return cubes.size();
+		}
+
+		const std::vector<uint32_t> &data() const
+		{
+			return cubes;
+		}
+
+		// Draws with su::mvp, falls back to a display list of drawCube calls if vertex pulling is unavailable or not requested.
+		void draw(RenderPath path)
+		{
+			if (path != RenderPath::Immediate && VertexPulling::available)
+			{
+				if (bufferDirty)
+					uploadBuffer();
+				VertexPulling::draw(cubeTexture, cubes.size(), gridWidth, gridHeight, gridDepth);
+				return;
+			}
+
+			if (listDirty)
+				compileList();
+
+			// The display list holds untransformed vertices, so the transformation moves to the fixed function pipeline
+			RenderStats::matrixMode(GL_PROJECTION);
+			RenderStats::loadMatrix(&mvp[0][0]);
+			glCallList(displayList);
+			RenderStats::loadIdentity();
+			RenderStats::drawCall(GL_TRIANGLES, 36 * cubes.size());
+			RenderStats::upload(sizeof(mvp));
+		}
+
+	private:
+		size_t gridWidth, gridHeight, gridDepth;
+		std::vector<uint32_t> cubes;
+
+		bool bufferDirty = true;
+		GLuint cubeBuffer = 0;
+		GLuint cubeTexture = 0;
+		size_t cubeBufferCapacity = 0;
+
+		bool listDirty = true;
+		GLuint displayList = 0;
+
+		void uploadBuffer()
+		{
+			if (cubeBuffer == 0)
+			{
+				GLExt::GenBuffers(1, &cubeBuffer);
+				glGenTextures(1, &cubeTexture);
+			}
+
+			size_t bytes = cubes.size() * sizeof(uint32_t);
+			RenderStats::bindBuffer(GL_TEXTURE_BUFFER, cubeBuffer);
+			if (bytes > cubeBufferCapacity)
+			{
+				cubeBufferCapacity = std::max<size_t>(bytes * 2, 64);
+				GLExt::BufferData(GL_TEXTURE_BUFFER, cubeBufferCapacity, nullptr, GL_STREAM_DRAW);
+
+				RenderStats::bindTexture(GL_TEXTURE_BUFFER, cubeTexture);
+				GLExt::TexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, cubeBuffer);
+				RenderStats::bindTexture(GL_TEXTURE_BUFFER, 0);
+			}
+			GLExt::BufferSubData(GL_TEXTURE_BUFFER, 0, bytes, cubes.data());
+			RenderStats::bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+			RenderStats::upload(bytes);
+			bufferDirty = false;
+		}
+
+		void compileList()
+		{
+			if (displayList == 0)
+				displayList = glGenLists(1);
+
+			glm::mat4 transform = mvp;
+			mvp = glm::mat4();
+
+			glNewList(displayList, GL_COMPILE);
+			glBegin(GL_TRIANGLES);
+			for (uint32_t cube : cubes)
+			{
+				size_t index = cube & 0xFFFFFF;
+				glm::vec3 p{
+					static_cast<float>(index % gridWidth),
+					static_cast<float>((index / gridWidth) % gridHeight),
+					static_cast<float>(index / (gridWidth * gridHeight))
+				};
+				drawCube(p + glm::vec3(CUBE_SIZE_H), static_cast<Palette>(cube >> 24));
+			}
+			glEnd();
+			glEndList();
+
+			mvp = transform;
+			listDirty = false;
+		}
+	};
+
+	// Renders the whole field in one draw by raymarching a 3D texture that holds the palette index + 1
+	// of every cell (0 is empty). Only texels that changed since the last update are uploaded.
+	namespace Raymarcher
+	{
+		const char *VERTEX_SHADER = R"(#version 140
+uniform mat4 uMvp;
+uniform ivec3 uGridSize;
+
+const int CORNERS[36] = int[36](0, 1, 2, 2, 3, 0,  6, 5, 4, 4, 7, 6,  3, 2, 6, 6, 7, 3,  5, 1, 0, 0, 4, 5,  2, 1, 5, 5, 6, 2,  4, 0, 3, 3, 7, 4);
+const vec3 OFFSETS[8] = vec3[8](vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 1.0), vec3(0.0, 1.0, 1.0),
+                                vec3(0.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 1.0), vec3(0.0, 0.0, 1.0));
+
+void main()
+{
+	gl_Position = uMvp * vec4(OFFSETS[CORNERS[gl_VertexID]] * vec3(uGridSize), 1.0);
+}
+)";
+
+		const char *FRAGMENT_SHADER = R"(#version 140
+uniform mat4 uMvp;
+uniform mat4 uInvMvp;
+uniform vec4 uViewport;
+uniform ivec3 uGridSize;
+uniform float uCubeSize;
+uniform vec3 uPaletteShades[16 * 6];
+uniform usampler3D uOccupancy;
+
+out vec4 fragColor;
+
+// Returns the face in the order of su::Face: top, bottom, front, back, right, left
+bool intersectBox(vec3 ro, vec3 rd, vec3 bmin, vec3 bmax, out float tNear, out float tFar, out int face)
+{
+	vec3 t0 = (bmin - ro) / rd;
+	vec3 t1 = (bmax - ro) / rd;
+	vec3 tMin = min(t0, t1);
+	vec3 tMax = max(t0, t1);
+	tNear = max(max(tMin.x, tMin.y), tMin.z);
+	tFar = min(min(tMax.x, tMax.y), tMax.z);
+
+	if (tNear == tMin.x)
+		face = rd.x > 0.0 ? 5 : 4;
+	else if (tNear == tMin.y)
+		face = rd.y > 0.0 ? 1 : 0;
+	else
+		face = rd.z > 0.0 ? 3 : 2;
+
+	return tFar >= max(tNear, 0.0);
+}
+
+void main()
+{
+	// Ray from the near to the far plane through this pixel, in field space
+	vec2 ndc = (gl_FragCoord.xy - uViewport.xy) / uViewport.zw * 2.0 - 1.0;
+	vec4 near = uInvMvp * vec4(ndc, -1.0, 1.0);
+	vec4 far = uInvMvp * vec4(ndc, 1.0, 1.0);
+	vec3 ro = near.xyz / near.w;
+	vec3 rd = far.xyz / far.w - ro;
+	rd = mix(rd, vec3(1e-6), equal(rd, vec3(0.0)));
+
+	float tNear, tFar;
+	int face;
+	if (!intersectBox(ro, rd, vec3(0.0), vec3(uGridSize), tNear, tFar, face))
+		discard;
+
+	// Walk the cells along the ray (Amanatides & Woo)
+	vec3 start = ro + rd * max(tNear, 0.0);
+	ivec3 cell = clamp(ivec3(floor(start)), ivec3(0), uGridSize - 1);
+	ivec3 stepDir = ivec3(sign(rd));
+	vec3 tDelta = abs(1.0 / rd);
+	vec3 tNext = (vec3(cell) + max(sign(rd), vec3(0.0)) - ro) / rd;
+
+	int maxSteps = uGridSize.x + uGridSize.y + uGridSize.z;
+	for (int i = 0; i < maxSteps; ++i)
+	{
+		uint value = texelFetch(uOccupancy, cell, 0).r;
+		if (value != 0u)
+		{
+			float cNear, cFar;
+			int cFace;
+			vec3 cmin = vec3(cell);
+			if (intersectBox(ro, rd, cmin, cmin + vec3(uCubeSize), cNear, cFar, cFace) && cNear >= 0.0)
+			{
+				vec4 clip = uMvp * vec4(ro + rd * cNear, 1.0);
+				gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+				fragColor = vec4(uPaletteShades[(int(value) - 1) * 6 + cFace], 1.0);
+				return;
+			}
+		}
+
+		if (tNext.x < tNext.y && tNext.x < tNext.z)
+		{
+			cell.x += stepDir.x;
+			tNext.x += tDelta.x;
+		}
+		else if (tNext.y < tNext.z)
+		{
+			cell.y += stepDir.y;
+			tNext.y += tDelta.y;
+		}
+		else
+		{
+			cell.z += stepDir.z;
+			tNext.z += tDelta.z;
+		}
+
+		if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, uGridSize)))
+			break;
+	}
+	discard;
+}
+)";
+
+		bool available = false;
+		GLuint program = 0;
+		GLuint vertexArray = 0;
+		GLuint occupancyTexture = 0;
+
+		GLint uMvp = -1;
+		GLint uInvMvp = -1;
+		GLint uViewport = -1;
+
+		// Cell contents as currently stored in the texture
+		std::array<uint8_t, FIELD_SIZE> occupancy;
+
+		// Requires GLExt::load to have succeeded.
+		void init()
+		{
+			program = GLExt::createProgram(VERTEX_SHADER, FRAGMENT_SHADER);
+			if (program == 0)
+				return;
+
+			uMvp = GLExt::GetUniformLocation(program, "uMvp");
+			uInvMvp = GLExt::GetUniformLocation(program, "uInvMvp");
+			uViewport = GLExt::GetUniformLocation(program, "uViewport");
+
+			GLExt::UseProgram(program);
+			GLExt::Uniform1i(GLExt::GetUniformLocation(program, "uOccupancy"), 0);
+			GLExt::Uniform3i(GLExt::GetUniformLocation(program, "uGridSize"), FIELD_WIDTH, FIELD_HEIGHT, FIELD_DEPTH);
+			GLExt::Uniform1f(GLExt::GetUniformLocation(program, "uCubeSize"), CUBE_SIZE);
+			GLExt::Uniform3fv(GLExt::GetUniformLocation(program, "uPaletteShades"), PALETTE_COUNT * FACE_COUNT, &PALETTE_SHADES[0][0][0]);
+			GLExt::UseProgram(0);
+
+			GLExt::GenVertexArrays(1, &vertexArray);
+
+			occupancy.fill(0);
+			glGenTextures(1, &occupancyTexture);
+			glBindTexture(GL_TEXTURE_3D, occupancyTexture);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			GLExt::TexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, FIELD_WIDTH, FIELD_HEIGHT, FIELD_DEPTH, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, occupancy.data());
+			glBindTexture(GL_TEXTURE_3D, 0);
+
+			available = true;
+		}
+
+		// Uploads the cells that differ from the cubes of the batch, usually just the old tail, the new head and the food.
+		void update(const CubeBatch &batch)
+		{
+			if (!available)
+				return;
+
+			std::array<uint8_t, FIELD_SIZE> cells;
+			cells.fill(0);
+			for (uint32_t cube : batch.data())
+				cells[cube & 0xFFFFFF] = static_cast<uint8_t>((cube >> 24) + 1);
+
+			RenderStats::bindTexture(GL_TEXTURE_3D, occupancyTexture);
+			for (size_t i = 0; i < FIELD_SIZE; ++i)
+			{
+				if (cells[i] == occupancy[i])
+					continue;
+
+				occupancy[i] = cells[i];
+				GLint x = static_cast<GLint>(i % FIELD_WIDTH);
+				GLint y = static_cast<GLint>((i / FIELD_WIDTH) % FIELD_HEIGHT);
+				GLint z = static_cast<GLint>(i / (FIELD_WIDTH * FIELD_HEIGHT));
+				GLExt::TexSubImage3D(GL_TEXTURE_3D, 0, x, y, z, 1, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &occupancy[i]);
+				RenderStats::upload(1);
+			}
+			RenderStats::bindTexture(GL_TEXTURE_3D, 0);
+		}
+
+		// Draws the back faces of the field bounds with su::mvp, the viewport is needed to reconstruct the rays.
+		void draw(float viewportX, float viewportY, float viewportWidth, float viewportHeight)
+		{
+			glm::mat4 invMvp = glm::inverse(mvp);
+
+			RenderStats::activeTexture(GL_TEXTURE0);
+			RenderStats::bindTexture(GL_TEXTURE_3D, occupancyTexture);
+
+			RenderStats::useProgram(program);
+			GLExt::UniformMatrix4fv(uMvp, 1, GL_FALSE, &mvp[0][0]);
+			GLExt::UniformMatrix4fv(uInvMvp, 1, GL_FALSE, &invMvp[0][0]);
+			GLExt::Uniform4f(uViewport, viewportX, viewportY, viewportWidth, viewportHeight);
+
+			// Back faces still cover every pixel of the field when the camera is inside of it
+			RenderStats::cullFace(GL_FRONT);
+			RenderStats::bindVertexArray(vertexArray);
+			glDrawArrays(GL_TRIANGLES, 0, 36);
+			RenderStats::bindVertexArray(0);
+			RenderStats::cullFace(GL_BACK);
+			RenderStats::drawCall(GL_TRIANGLES, 36);
+
+			RenderStats::useProgram(0);
+			RenderStats::bindTexture(GL_TEXTURE_3D, 0);
+			RenderStats::upload(2 * sizeof(mvp) + 4 * sizeof(GLfloat));
+		}
+	}
+
+	// Draws translucent cubes of many snakes with weighted blended order independent transparency (McGuire and Bavoil 2013).
+	// Cubes are pairs of cell index and ghost index in a buffer texture, the tint of each ghost comes from a second one.
+	// Both accumulation targets are blended with GL_ONE, GL_ONE: the revealage target sums -log(1 - alpha), so
+	// exp(-sum) is the product of (1 - alpha) and no per target blend functions (OpenGL 4.0) are needed.
+	namespace GhostRenderer
+	{
+		const char *VERTEX_SHADER = R"(#version 140
+uniform mat4 uMvp;
+uniform ivec3 uGridSize;
+uniform float uCubeSizeH;
+uniform float uFaceShades[6];
+uniform usamplerBuffer uCubes;
+uniform samplerBuffer uTints;
+
+flat out vec4 vColor;
+
+// Same corners and winding as su::drawCube
+const int CORNERS[36] = int[36](0, 1, 2, 2, 3, 0,  6, 5, 4, 4, 7, 6,  3, 2, 6, 6, 7, 3,  5, 1, 0, 0, 4, 5,  2, 1, 5, 5, 6, 2,  4, 0, 3, 3, 7, 4);
+const vec3 OFFSETS[8] = vec3[8](vec3(-1.0, 1.0, -1.0), vec3(1.0, 1.0, -1.0), vec3(1.0, 1.0, 1.0), vec3(-1.0, 1.0, 1.0),
+                                vec3(-1.0, -1.0, -1.0), vec3(1.0, -1.0, -1.0), vec3(1.0, -1.0, 1.0), vec3(-1.0, -1.0, 1.0));
+
+void main()
+{
+	int cell = int(texelFetch(uCubes, gl_InstanceID * 2).r);
+	int ghost = int(texelFetch(uCubes, gl_InstanceID * 2 + 1).r);
+	ivec3 p = ivec3(cell % uGridSize.x, (cell / uGridSize.x) % uGridSize.y, cell / (uGridSize.x * uGridSize.y));
+
+	vec3 center = vec3(p) + vec3(uCubeSizeH);
+	gl_Position = uMvp * vec4(center + OFFSETS[CORNERS[gl_VertexID]] * uCubeSizeH, 1.0);
+
+	vec4 tint = texelFetch(uTints, ghost);
+	vColor = vec4(tint.rgb * uFaceShades[gl_VertexID / 6], tint.a);
+}
+)";
+
+		const char *FRAGMENT_SHADER = R"(#version 140
+flat in vec4 vColor;
+
+out vec4 oAccum;
+out float oReveal;
+
+void main()
+{
+	float a = vColor.a;
+	float w = clamp(a * max(1e-2, 3e3 * pow(1.0 - gl_FragCoord.z, 3.0)), 1e-2, 3e3);
+	oAccum = vec4(vColor.rgb * a, a) * w;
+	oReveal = -log(1.0 - a);
+}
+)";
+
+		const char *COMPOSITE_VERTEX_SHADER = R"(#version 140
+void main()
+{
+	// One clockwise triangle that covers the viewport
+	gl_Position = vec4(gl_VertexID == 2 ? 3.0 : -1.0, gl_VertexID == 1 ? 3.0 : -1.0, 0.0, 1.0);
+}
+)";
+
+		const char *COMPOSITE_FRAGMENT_SHADER = R"(#version 140
+uniform sampler2D uAccum;
+uniform sampler2D uReveal;
+
+out vec4 fragColor;
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	float coverage = 1.0 - exp(-texelFetch(uReveal, p, 0).r);
+	if (coverage < 1e-3)
+		discard;
+
+	vec4 accum = texelFetch(uAccum, p, 0);
+	fragColor = vec4(accum.rgb / clamp(accum.a, 1e-4, 5e4), coverage);
+}
+)";
+
+		bool available = false;
+		GLuint program = 0;
+		GLuint compositeProgram = 0;
+		GLuint vertexArray = 0;
+
+		GLint uMvp = -1;
+
+		GLuint framebuffer = 0;
+		GLuint accumTexture = 0;
+		GLuint revealTexture = 0;
+		GLuint depthRenderbuffer = 0;
+		GLsizei framebufferWidth = 0, framebufferHeight = 0;
+
+		// Requires GLExt::load to have succeeded.
+		void init()
+		{
+			program = GLExt::createProgram(VERTEX_SHADER, FRAGMENT_SHADER, { "oAccum", "oReveal" });
+			compositeProgram = GLExt::createProgram(COMPOSITE_VERTEX_SHADER, COMPOSITE_FRAGMENT_SHADER);
+			if (program == 0 || compositeProgram == 0)
+				return;
+
+			uMvp = GLExt::GetUniformLocation(program, "uMvp");
+
+			GLExt::UseProgram(program);
+			GLExt::Uniform1i(GLExt::GetUniformLocation(program, "uCubes"), 0);
+			GLExt::Uniform1i(GLExt::GetUniformLocation(program, "uTints"), 1);
+			GLExt::Uniform3i(GLExt::GetUniformLocation(program, "uGridSize"), FIELD_WIDTH, FIELD_HEIGHT, FIELD_DEPTH);
+			GLExt::Uniform1f(GLExt::GetUniformLocation(program, "uCubeSizeH"), CUBE_SIZE_H);
+			for (size_t f = 0; f < FACE_COUNT; ++f)
+			{
+				std::string name = "uFaceShades[" + std::to_string(f) + "]";
+				GLExt::Uniform1f(GLExt::GetUniformLocation(program, name.c_str()), FACE_SHADES[f]);
+			}
+
+			GLExt::UseProgram(compositeProgram);
+			GLExt::Uniform1i(GLExt::GetUniformLocation(compositeProgram, "uAccum"), 0);
+			GLExt::Uniform1i(GLExt::GetUniformLocation(compositeProgram, "uReveal"), 1);
+			GLExt::UseProgram(0);
+
+			GLExt::GenVertexArrays(1, &vertexArray);
+
+			GLExt::GenFramebuffers(1, &framebuffer);
+			glGenTextures(1, &accumTexture);
+			glGenTextures(1, &revealTexture);
+			GLExt::GenRenderbuffers(1, &depthRenderbuffer);
+
+			available = true;
+		}
+
+		// (Re)allocates the targets when the window size changed, returns false if the framebuffer is unusable.
+		bool resize(GLsizei width, GLsizei height)
+		{
+			if (width == framebufferWidth && height == framebufferHeight)
+				return true;
+
+			framebufferWidth = width;
+			framebufferHeight = height;
+
+			GLuint textures[2] = { accumTexture, revealTexture };
+			GLint formats[2] = { GL_RGBA16F, GL_R16F };
+			GLenum layouts[2] = { GL_RGBA, GL_RED };
+			for (int i = 0; i < 2; ++i)
+			{
+				RenderStats::bindTexture(GL_TEXTURE_2D, textures[i]);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, layouts[i], GL_FLOAT, nullptr);
+			}
+			RenderStats::bindTexture(GL_TEXTURE_2D, 0);
+
+			RenderStats::bindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+			GLExt::RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+			RenderStats::bindRenderbuffer(GL_RENDERBUFFER, 0);
+
+			RenderStats::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			GLExt::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+			GLExt::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealTexture, 0);
+			GLExt::FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+			const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			GLExt::DrawBuffers(2, drawBuffers);
+			GLenum status = GLExt::CheckFramebufferStatus(GL_FRAMEBUFFER);
+			RenderStats::bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			if (status != GL_FRAMEBUFFER_COMPLETE)
+			{
+				Debug::cerr("Ghost framebuffer is incomplete (", status, "), ghosts are disabled.\n");
+				available = false;
+				return false;
+			}
+			return true;
+		}
+
+		// Binds and clears the accumulation targets. The depth of the occluders is drawn again with su::mvp,
+		// so ghosts behind the scene are hidden without sharing the depth buffer of the window.
+		bool begin(GLsizei windowWidth, GLsizei windowHeight, CubeBatch &occluders)
+		{
+			if (!available || !resize(windowWidth, windowHeight))
+				return false;
+
+			RenderStats::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			RenderStats::clearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			RenderStats::clearColor(BG_R, BG_G, BG_B, 1.0f);
+
+			RenderStats::colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			occluders.draw(RenderPath::VertexPulling);
+			RenderStats::colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+			RenderStats::depthMask(GL_FALSE);
+			RenderStats::blendFunc(GL_ONE, GL_ONE);
+			return true;
+		}
+
+		// Draws count cubes with su::mvp between begin and end.
+		void draw(GLuint cubeTexture, GLuint tintTexture, size_t count)
+		{
+			if (count == 0)
+				return;
+
+			RenderStats::activeTexture(GL_TEXTURE1);
+			RenderStats::bindTexture(GL_TEXTURE_BUFFER, tintTexture);
+			RenderStats::activeTexture(GL_TEXTURE0);
+			RenderStats::bindTexture(GL_TEXTURE_BUFFER, cubeTexture);
+
+			RenderStats::useProgram(program);
+			GLExt::UniformMatrix4fv(uMvp, 1, GL_FALSE, &mvp[0][0]);
+			RenderStats::upload(sizeof(mvp));
+
+			RenderStats::bindVertexArray(vertexArray);
+			GLExt::DrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(count));
+			RenderStats::bindVertexArray(0);
+			RenderStats::drawCall(GL_TRIANGLES, 36, count);
+
+			RenderStats::useProgram(0);
+			RenderStats::bindTexture(GL_TEXTURE_BUFFER, 0);
+			RenderStats::activeTexture(GL_TEXTURE1);
+			RenderStats::bindTexture(GL_TEXTURE_BUFFER, 0);
+			RenderStats::activeTexture(GL_TEXTURE0);
+		}
+
+		// Restores the window framebuffer and blends the resolved ghosts over the current viewport.
+		void end()
+		{
+			RenderStats::depthMask(GL_TRUE);
+			RenderStats::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			RenderStats::bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			RenderStats::activeTexture(GL_TEXTURE1);
+			RenderStats::bindTexture(GL_TEXTURE_2D, revealTexture);
+			RenderStats::activeTexture(GL_TEXTURE0);
+			RenderStats::bindTexture(GL_TEXTURE_2D, accumTexture);
+
+			RenderStats::disable(GL_DEPTH_TEST);
+			RenderStats::useProgram(compositeProgram);
+			RenderStats::bindVertexArray(vertexArray);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			RenderStats::bindVertexArray(0);
+			RenderStats::useProgram(0);
+			RenderStats::enable(GL_DEPTH_TEST);
+			RenderStats::drawCall(GL_TRIANGLES, 3);
+
+			RenderStats::bindTexture(GL_TEXTURE_2D, 0);
+			RenderStats::activeTexture(GL_TEXTURE1);
+			RenderStats::bindTexture(GL_TEXTURE_2D, 0);
+			RenderStats::activeTexture(GL_TEXTURE0);
+		}
+	}
+
+	// Field and snake are templates on the arena size, so the benchmarks can run them on bigger arenas than the game.
+	// The game uses the Field and Snake aliases below.
+	template<size_t W, size_t H, size_t D>
+	class BasicField
+	{
+	public:
+		constexpr static size_t SIZE = W * H * D;
+		constexpr static size_t MAX_OBSTACLES = SIZE + 5;
+
+		BasicField()
+			: BasicField(static_cast<unsigned int>(time(0)))
+		{
+
+		}
+
+		// Fields with the same seed place their food at the same cells, which makes games replayable
+		explicit BasicField(unsigned int seed)
+			: random(seed)
+		{
+			newFood();
+		}
+		
+		void draw(CubeBatch &batch) const
+		{
+			batch.add(food, PALETTE_FOOD);
+		}
+
+		constexpr size_t getWidth() const
+		{
+			return W;
+		}
+
+		constexpr size_t getHeight() const
+		{
+			return H;
+		}
+
+		constexpr size_t getDepth() const
+		{
+			return D;
+		}
+
+		const glm::vec3 &getFood() const
+		{
+			return food;
+		}
+
+		// Benchmarks use this to keep the food out of the way
+		void setFood(const glm::vec3 &cell)
+		{
+			food = cell;
+		}
+
+		void newFood()
+		{
+			PROFILE_ZONE("Field::newFood");
+			PerfCounters::Scope counters(PerfCounters::SECTION_NEW_FOOD);
+			int x = Randomf::randomInt(random, 0, static_cast<int>(W) - 1);
+			int y = Randomf::randomInt(random, 0, static_cast<int>(H) - 1);
+			int z = Randomf::randomInt(random, 0, static_cast<int>(D) - 1);
+
+			food.x = static_cast<float>(x);
+			food.y = static_cast<float>(y);
+			food.z = static_cast<float>(z);
+		}
+
+	private:
+		//std::array<glm::vec2, MAX_OBSTACLES> obstacles;
+		glm::vec3 food;
+		std::default_random_engine random;
+	};
+
+
+	template<size_t W, size_t H, size_t D>
+	class BasicSnake
+	{
+	public:
+		using pos_t = glm::vec3;
+		using part_t = pos_t;
+		using field_t = BasicField<W, H, D>;
+
+		BasicSnake(field_t &field)
+			: field(field)
+		{
+
+		}
+
+		constexpr static size_t MAX_LENGTH = field_t::SIZE + 5;
+
+		void setDirection(const pos_t &dir)
+		{
+			this->rdir = dir;
+		}
+
+		void reset(const pos_t &position)
+		{
+			for (size_t i = 0; i < getLength(); ++i)
+			{
+				parts[i] = position;
+			}
+			head = 0;
+			tail = 0;
+		}
+
+		size_t leftIndex(size_t index)
+		{
+			if (index == 0)
+				return length - 1;
+			return index - 1;
+		}
+
+		size_t rightIndex(size_t index)
+		{
+			if (index == length - 1)
+				return 0;
+			return index + 1;
+		}
+
+		void grow()
+		{
+			//    H 1 T
+			// -> H 1 2 T
+
+			//    1 T H
+			// -> 1 2 T H
+
+			//    T H 1
+			// -> 2 T H 1
+
+			// push tail sequence to the right and insert tail at old tail
+			// move head to right except if head is zero, then the head is on the tails left side
+			// Implementation: copy objects from left to right starting from the right side moving towards the tail (left) -> tail is dublicated automatically
+
+			size_t index = length;
+			while (index != tail)
+			{
+				parts[index] = parts[index - 1];
+				--index;
+			}
+			++length;
+			++tail;
+			if(head > 0)
+				++head;
+
+			if (length > bestLength)
+				bestLength = length;
+		}
+
+		// Other snakes on the same field are obstacles.
+		void update(const std::vector<const BasicSnake *> &others = {})
+		{
+			PROFILE_ZONE("Snake::update");
+			PerfCounters::Scope counters(PerfCounters::SECTION_SNAKE_UPDATE);
+			// Just change if direction is not the opposite
+			if (this->cdir + rdir != pos_t())
+				this->cdir = rdir;
+
+			// Last part to new first part
+			// Implementation: index magic, as this is not a dynamic list
+
+			pos_t newPos = wrap(parts[head] + cdir);
+
+			// Check if new position is deadly. Other snakes may have moved already or eat this tick, so all of their parts count.
+			bool dead = collides(newPos);
+			for (const BasicSnake *other : others)
+				dead = dead || other->collides(newPos, false);
+
+			if (dead)
+			{
+				length = 1;
+				reset(freeSpawn(others));
+				return;
+			}
+
+			// Check if new position is food
+			if (field.getFood() == newPos)
+			{
+				grow();
+				field.newFood();
+			}
+
+			head = leftIndex(head);
+			tail = leftIndex(head);
+
+			parts[head] = newPos;
+		}
+
+		// Moves positions that left the field in by one step back in on the opposite side
+		static pos_t wrap(pos_t p)
+		{
+			if (p.x < 0.0f)
+				p.x = W - 1;
+			if (p.x > W - 1)
+				p.x = 0.0f;
+
+			if (p.y < 0.0f)
+				p.y = H - 1;
+			if (p.y > H - 1)
+				p.y = 0.0f;
+
+			if (p.z < 0.0f)
+				p.z = D - 1;
+			if (p.z > D - 1)
+				p.z = 0.0f;
+			return p;
+		}
+
+		// Whether a part is at p. By default the tail is skipped, as the next update of this snake removes it.
+		bool collides(const pos_t &p, bool skipTail = true) const
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				if (parts[i] == p && !(skipTail && i == tail))
+					return true;
+			}
+			return false;
+		}
+
+		// Lays the snake along count cells, cellAt(0) is the head. Benchmarks build long snakes with it,
+		// growing them one part at a time would take quadratic time.
+		// The head goes to parts[headIndex] and the rest follows to the right, wrapping around at count.
+		template<typename CellAt>
+		void assign(size_t count, CellAt cellAt, const pos_t &direction, size_t headIndex = 0)
+		{
+			for (size_t i = 0; i < count; ++i)
+				parts[(headIndex + i) % count] = cellAt(i);
+			length = count;
+			head = headIndex;
+			tail = (headIndex + count - 1) % count;
+			bestLength = std::max(bestLength, length);
+			cdir = direction;
+			rdir = direction;
+		}
+
+		// Where the snake starts again after dying
+		void setSpawn(const pos_t &position)
+		{
+			spawn = position;
+		}
+
+		size_t getLength() const
+		{
+			return this->length;
+		}
+
+		size_t getBestLength() const
+		{
+			return this->bestLength;
+		}
+
+		void draw(CubeBatch &batch, Palette palette = PALETTE_SNAKE) const
+		{
+			for (size_t i = 0; i < getLength(); ++i)
+			{
+				batch.add(parts[i], i == head ? PALETTE_HEAD : palette);
+			}
+		}
+
+		const pos_t &getPart(size_t index) const
+		{
+			return parts[index];
+		}
+
+		const pos_t &getDirection() const
+		{
+			return cdir;
+		}
+
+		const pos_t &getHeadPos() const
+		{
+			return parts[head];
+		}
+
+	private:
+		// The spawn cell, or the next cell in memory order that no other snake occupies
+		pos_t freeSpawn(const std::vector<const BasicSnake *> &others) const
+		{
+			size_t start = static_cast<size_t>(spawn.x) + W * (static_cast<size_t>(spawn.y) + H * static_cast<size_t>(spawn.z));
+			for (size_t i = 0; i < field_t::SIZE; ++i)
+			{
+				size_t index = (start + i) % field_t::SIZE;
+				pos_t cell(static_cast<float>(index % W), static_cast<float>((index / W) % H), static_cast<float>(index / (W * H)));
+
+				bool occupied = false;
+				for (const BasicSnake *other : others)
+					occupied = occupied || other->collides(cell, false);
+				if (!occupied)
+					return cell;
+			}
+			return spawn;
+		}
+
+		field_t &field;
+
+		pos_t cdir = pos_t(0.0f, 1.0f, 0.0f); // current direction
+		pos_t rdir = pos_t(0.0f, 1.0f, 0.0f); // requested direction
+		size_t length = 1;
+		size_t head = 0;
+		size_t tail = length - 1;
+		size_t bestLength = length;
+		pos_t spawn = pos_t(1.0f, 1.0f, 1.0f);
+
+		std::array<part_t, MAX_LENGTH> parts;
+	};
+
+	using Field = BasicField<FIELD_WIDTH, FIELD_HEIGHT, FIELD_DEPTH>;
+	using Snake = BasicSnake<FIELD_WIDTH, FIELD_HEIGHT, FIELD_DEPTH>;
+
+	// Emits the edges of the field into a GL_LINES block, transformed with su::mvp
+	void drawFieldBorders()
+	{
+		glColor4f(0.8f, 0.2f, 0.2f, 0.4f);
+		RenderStats::immediate(16, 1);
+
+		glm::vec4 v0b = transformPosition4({ 0.0f, 0.0f, 0.0f, 1.0f });
+		glm::vec4 v1b = transformPosition4({ +FIELD_WIDTH_F, 0.0f, 0.0f, 1.0f });
+		glm::vec4 v2b = transformPosition4({ +FIELD_WIDTH_F, 0.0f, +FIELD_DEPTH_F, 1.0f });
+		glm::vec4 v3b = transformPosition4({ 0.0f, 0.0f, +FIELD_DEPTH_F, 1.0f });
+
+		glm::vec4 v0t = transformPosition4({ 0.0f, +FIELD_HEIGHT_F, 0.0f, 1.0f });
+		glm::vec4 v1t = transformPosition4({ +FIELD_WIDTH_F, +FIELD_HEIGHT_F, 0.0f, 1.0f });
+		glm::vec4 v2t = transformPosition4({ +FIELD_WIDTH_F, +FIELD_HEIGHT_F, +FIELD_DEPTH_F, 1.0f });
+		glm::vec4 v3t = transformPosition4({ 0.0f, +FIELD_HEIGHT_F, +FIELD_DEPTH_F, 1.0f });
+
+		glVertex4fv(&v0b[0]);
+		glVertex4fv(&v1b[0]);
+
+		glVertex4fv(&v1b[0]);
+		glVertex4fv(&v2b[0]);
+
+		glVertex4fv(&v2b[0]);
+		glVertex4fv(&v3b[0]);
+
+		glVertex4fv(&v3b[0]);
+		glVertex4fv(&v0b[0]);
+
+		glVertex4fv(&v0t[0]);
+		glVertex4fv(&v1t[0]);
+
+		glVertex4fv(&v1t[0]);
+		glVertex4fv(&v2t[0]);
+
+		glVertex4fv(&v2t[0]);
+		glVertex4fv(&v3t[0]);
+
+		glVertex4fv(&v3t[0]);
+		glVertex4fv(&v0t[0]);
+	}
+
+	// Fixed orthographic views that are shown next to the orbit camera
+	struct OrthoView
+	{
+		glm::vec3 direction; // from the field center to the eye
+		glm::vec3 up;
+	};
+
+	const OrthoView ORTHO_VIEWS[] = {
+		{ { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } }, // top
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } },  // front
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } }   // side
+	};
+
+	constexpr size_t ORTHO_VIEW_COUNT = sizeof(ORTHO_VIEWS) / sizeof(ORTHO_VIEWS[0]);
+
+	// View projection of a square orthographic view that fits the whole field.
+	glm::mat4 orthoViewProjection(const OrthoView &view)
+	{
+		float extent = 0.6f * std::max(FIELD_WIDTH_F, std::max(FIELD_HEIGHT_F, FIELD_DEPTH_F));
+		glm::mat4 p = glm::ortho(-extent, extent, -extent, extent, 0.1f, 100.0f);
+		glm::mat4 v = glm::lookAt(view.direction * 50.0f, glm::vec3(0.0f, 0.0f, 0.0f), view.up);
+		return p * v;
+	}
+
+	// p, h, r
+	const glm::vec3 DEFAULT_SPHERICAL_COORDS{ glm::half_pi<float>(), glm::half_pi<float>() * 0.5f, 15.0f };
+
+	// x = p, y = a|h, z = r
+	glm::vec3 toCartesianCoords(const glm::vec3 &shericalCoords)
+	{
+		return {
+			shericalCoords.z * glm::sin(shericalCoords.x) * glm::cos(shericalCoords.y),
+			shericalCoords.z * glm::cos(shericalCoords.x),
+			shericalCoords.z * glm::sin(shericalCoords.x) * glm::sin(shericalCoords.y)
+		};
+	}
+
+	bool isH1(const glm::vec3 &sphericalCoords) // bottom
+	{
+		return sphericalCoords.y > 0.25f * glm::pi<float>() && sphericalCoords.y <= 0.75f * glm::pi<float>();
+	}
+
+	bool isH2(const glm::vec3 &sphericalCoords) // left
+	{
+		return sphericalCoords.y > 0.75f * glm::pi<float>() && sphericalCoords.y <= 1.25f * glm::pi<float>();
+	}
+
+	bool isH3(const glm::vec3 &sphericalCoords) // top
+	{
+		return sphericalCoords.y > 1.25f * glm::pi<float>() && sphericalCoords.y <= 1.75f * glm::pi<float>();
+	}
+	// else right
+
+	enum Move
+	{
+		MOVE_FORWARD,
+		MOVE_BACKWARD,
+		MOVE_LEFT,
+		MOVE_RIGHT,
+		MOVE_UP,
+		MOVE_DOWN,
+
+		MOVE_COUNT,
+		MOVE_NONE = MOVE_COUNT
+	};
+
+	// Direction of a move as seen from a camera at sphericalCoords
+	glm::vec3 moveDirection(const glm::vec3 &sphericalCoords, Move move)
+	{
+		switch (move)
+		{
+		case MOVE_FORWARD:
+			// opposite dir
+			if (isH1(sphericalCoords)) // from +z
+				return { +0.0f, +0.0f, -1.0f };
+			else if (isH2(sphericalCoords)) // from -x
+				return { +1.0f, +0.0f, +0.0f };
+			else if (isH3(sphericalCoords)) // from -z
+				return { +0.0f, +0.0f, +1.0f };
+			else // from +x
+				return { -1.0f, +0.0f, +0.0f };
+		case MOVE_BACKWARD:
+			// same dir
+			if (isH1(sphericalCoords)) // from +z
+				return { +0.0f, +0.0f, +1.0f };
+			else if (isH2(sphericalCoords)) // from -x
+				return { -1.0f, +0.0f, +0.0f };
+			else if (isH3(sphericalCoords)) // from -z
+				return { +0.0f, +0.0f, -1.0f };
+			else // from +x
+				return { +1.0f, +0.0f, +0.0f };
+		case MOVE_LEFT:
+			// left dir
+			if (isH1(sphericalCoords)) // from +z
+				return { -1.0f, +0.0f, +0.0f };
+			else if (isH2(sphericalCoords)) // from -x
+				return { +0.0f, +0.0f, -1.0f };
+			else if (isH3(sphericalCoords)) // from -z
+				return { +1.0f, +0.0f, +0.0f };
+			else // from +x
+				return { +0.0f, +0.0f, +1.0f };
+		case MOVE_RIGHT:
+			// right dir
+			if (isH1(sphericalCoords)) // from +z
+				return { +1.0f, +0.0f, +0.0f };
+			else if (isH2(sphericalCoords)) // from -x
+				return { +0.0f, +0.0f, +1.0f };
+			else if (isH3(sphericalCoords)) // from -z
+				return { -1.0f, +0.0f, +0.0f };
+			else // from +x
+				return { +0.0f, +0.0f, -1.0f };
+		case MOVE_UP:
+			return { +0.0f, +1.0f, +0.0f };
+		case MOVE_DOWN:
+		default:
+			return { +0.0f, -1.0f, +0.0f };
+		}
+	}
+
+	constexpr size_t MAX_PLAYERS = 4;
+
+	// Keys of every player in the order of su::Move
+	const int PLAYER_CONTROLS[MAX_PLAYERS][MOVE_COUNT] = {
+		{ GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_SPACE, GLFW_KEY_LEFT_SHIFT },
+		{ GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_RIGHT_CONTROL, GLFW_KEY_RIGHT_SHIFT },
+		{ GLFW_KEY_I, GLFW_KEY_K, GLFW_KEY_J, GLFW_KEY_L, GLFW_KEY_U, GLFW_KEY_O },
+		{ GLFW_KEY_KP_8, GLFW_KEY_KP_5, GLFW_KEY_KP_4, GLFW_KEY_KP_6, GLFW_KEY_KP_9, GLFW_KEY_KP_7 }
+	};
+
+	const Palette PLAYER_PALETTES[MAX_PLAYERS] = { PALETTE_SNAKE, PALETTE_SNAKE_2, PALETTE_SNAKE_3, PALETTE_SNAKE_4 };
+
+	const glm::vec3 PLAYER_SPAWNS[MAX_PLAYERS] = {
+		{ 1.0f, 1.0f, 1.0f },
+		{ FIELD_WIDTH_F - 2.0f, 1.0f, FIELD_DEPTH_F - 2.0f },
+		{ 1.0f, 1.0f, FIELD_DEPTH_F - 2.0f },
+		{ FIELD_WIDTH_F - 2.0f, 1.0f, 1.0f }
+	};
+
+	Move controlsMove(size_t player, int key)
+	{
+		for (int m = 0; m < MOVE_COUNT; ++m)
+		{
+			if (PLAYER_CONTROLS[player][m] == key)
+				return static_cast<Move>(m);
+		}
+		return MOVE_NONE;
+	}
+
+	// Window area in OpenGL coordinates (origin at the bottom left)
+	struct Viewport
+	{
+		GLint x = 0, y = 0;
+		GLsizei width = 1, height = 1;
+
+		// Takes GLFW cursor coordinates (origin at the top left)
+		bool contains(double cx, double cy, float windowHeight) const
+		{
+			double gy = windowHeight - cy;
+			return cx >= x && cx < x + width && gy >= y && gy < y + height;
+		}
+
+		float aspect() const
+		{
+			return static_cast<float>(width) / static_cast<float>(height);
+		}
+	};
+
+	// One viewport for 1 player, side by side for 2 and a 2x2 grid for 3 and 4.
+	Viewport splitScreenViewport(size_t index, size_t count, float windowWidth, float windowHeight)
+	{
+		GLsizei w = static_cast<GLsizei>(windowWidth);
+		GLsizei h = static_cast<GLsizei>(windowHeight);
+
+		Viewport viewport;
+		if (count <= 1)
+		{
+			viewport.width = w;
+			viewport.height = h;
+		}
+		else if (count == 2)
+		{
+			viewport.x = static_cast<GLint>(index) * (w / 2);
+			viewport.width = w / 2;
+			viewport.height = h;
+		}
+		else
+		{
+			viewport.x = static_cast<GLint>(index % 2) * (w / 2);
+			viewport.y = index < 2 ? h / 2 : 0;
+			viewport.width = w / 2;
+			viewport.height = h / 2;
+		}
+		viewport.width = std::max<GLsizei>(viewport.width, 1);
+		viewport.height = std::max<GLsizei>(viewport.height, 1);
+		return viewport;
+	}
+
+	constexpr size_t GLYPH_HEIGHT = 5;
+
+	// Block font, one string per row from top to bottom, '#' marks a filled cell
+	struct Glyph
+	{
+		char c;
+		const char *rows[GLYPH_HEIGHT];
+	};
+
+	const Glyph GLYPHS[] = {
+		{ '0', { "###", "#.#", "#.#", "#.#", "###" } },
+		{ '1', { ".##", "#.#", "..#", "..#", "..#" } },
+		{ '2', { "###", "..#", "###", "#..", "###" } },
+		{ '3', { "###", "..#", ".##", "..#", "###" } },
+		{ '4', { "#..", "#.#", "###", "..#", "..#" } },
+		{ '5', { "###", "#..", "###", "..#", "###" } },
+		{ '6', { "###", "#..", "###", "#.#", "###" } },
+		{ '7', { "###", "..#", ".##", "..#", "..#" } },
+		{ '8', { "###", "#.#", "###", "#.#", "###" } },
+		{ '9', { "###", "#.#", "###", "..#", "###" } },
+		{ 'A', { ".#.", "#.#", "###", "#.#", "#.#" } },
+		{ 'B', { "##.", "#.#", "##.", "#.#", "##." } },
+		{ 'C', { "###", "#..", "#..", "#..", "###" } },
+		{ 'D', { "##.", "#.#", "#.#", "#.#", "##." } },
+		{ 'E', { "###", "#..", "##.", "#..", "###" } },
+		{ 'F', { "###", "#..", "##.", "#..", "#.." } },
+		{ 'G', { "###", "#..", "#.#", "#.#", "###" } },
+		{ 'H', { "#.#", "#.#", "###", "#.#", "#.#" } },
+		{ 'I', { "###", ".#.", ".#.", ".#.", "###" } },
+		{ 'J', { "..#", "..#", "..#", "#.#", "###" } },
+		{ 'K', { "#.#", "#.#", "##.", "#.#", "#.#" } },
+		{ 'L', { "#..", "#..", "#..", "#..", "###" } },
+		{ 'M', { "#...#", "##.##", "#.#.#", "#...#", "#...#" } },
+		{ 'N', { "#..#", "##.#", "####", "#.##", "#..#" } },
+		{ 'O', { ".#.", "#.#", "#.#", "#.#", ".#." } },
+		{ 'P', { "###", "#.#", "###", "#..", "#.." } },
+		{ 'Q', { ".#.", "#.#", "#.#", "##.", ".##" } },
+		{ 'R', { "##.", "#.#", "##.", "#.#", "#.#" } },
+		{ 'S', { "###", "#..", "###", "..#", "###" } },
+		{ 'T', { "###", ".#.", ".#.", ".#.", ".#." } },
+		{ 'U', { "#.#", "#.#", "#.#", "#.#", "###" } },
+		{ 'V', { "#.#", "#.#", "#.#", "#.#", ".#." } },
+		{ 'W', { "#...#", "#...#", "#.#.#", "##.##", "#...#" } },
+		{ 'X', { "#.#", "#.#", ".#.", "#.#", "#.#" } },
+		{ 'Y', { "#.#", "#.#", ".#.", ".#.", ".#." } },
+		{ 'Z', { "###", "..#", ".#.", "#..", "###" } },
+		{ ':', { ".", "#", ".", "#", "." } },
+		{ '.', { ".", ".", ".", ".", "#" } },
+		{ '/', { "..#", "..#", ".#.", "#..", "#.." } },
+		{ '-', { "...", "...", "###", "...", "..." } },
+		{ ' ', { "..", "..", "..", "..", ".." } }
+	};
+
+	// Lower case letters use the upper case glyphs
+	const Glyph *findGlyph(char c)
+	{
+		if (c >= 'a' && c <= 'z')
+			c = static_cast<char>(c - 'a' + 'A');
+
+		for (const Glyph &glyph : GLYPHS)
+		{
+			if (glyph.c == c)
+				return &glyph;
+		}
+		return nullptr;
+	}
+
+	// Screen-space text in the block font. The anchor is a point of the viewport in [0, 1], the pivot is the point
+	// of the text box that is placed there, offset is in cells and size is the cell size relative to the viewport height.
+	// Layout and geometry are kept in a display list that is only rebuilt when the text or its colour changes.
+	class HudText
+	{
+	public:
+		HudText(const glm::vec2 &anchor, const glm::vec2 &pivot, const glm::vec2 &offset, float size, Palette palette)
+			: anchor(anchor), pivot(pivot), offset(offset), size(size), palette(palette)
+		{
+
+		}
+
+		HudText(const HudText &) = delete;
+		HudText &operator=(const HudText &) = delete;
+
+		// The display list stays with other, this one is compiled again on its first draw
+		HudText(HudText &&other)
+			: anchor(other.anchor), pivot(other.pivot), offset(other.offset), size(other.size), palette(other.palette),
+			  text(std::move(other.text)), hasNumber(other.hasNumber), number(other.number)
+		{
+
+		}
+
+		~HudText()
+		{
+			if (displayList != 0)
+				glDeleteLists(displayList, 1);
+		}
+
+		void set(const std::string &text)
+		{
+			if (text == this->text)
+				return;
+
+			this->text = text;
+			dirty = true;
+		}
+
+		void setNumber(size_t number)
+		{
+			if (hasNumber && number == this->number)
+				return;
+
+			hasNumber = true;
+			this->number = number;
+			set(std::to_string(number));
+		}
+
+		void setPalette(Palette palette)
+		{
+			if (palette == this->palette)
+				return;
+
+			this->palette = palette;
+			dirty = true;
+		}
+
+		// Expects depth testing to be off
+		void draw(const Viewport &viewport)
+		{
+			if (dirty)
+				compileList();
+
+			float cell = size * static_cast<float>(viewport.height);
+			glm::vec2 screenSize(static_cast<float>(viewport.width), static_cast<float>(viewport.height));
+			glm::vec2 origin = anchor * screenSize + (offset - pivot * glm::vec2(width, static_cast<float>(GLYPH_HEIGHT))) * cell;
+
+			glm::mat4 transform = glm::ortho(0.0f, screenSize.x, 0.0f, screenSize.y, -1.0f, 1.0f);
+			transform = glm::translate(transform, glm::vec3(glm::floor(origin), 0.0f));
+			transform = glm::scale(transform, glm::vec3(cell, cell, 1.0f));
+
+			RenderStats::matrixMode(GL_PROJECTION);
+			RenderStats::loadMatrix(&transform[0][0]);
+			glCallList(displayList);
+			RenderStats::loadIdentity();
+			RenderStats::drawCall(GL_TRIANGLES, 6 * cells);
+			RenderStats::upload(sizeof(transform));
+		}
+
+	private:
+		glm::vec2 anchor, pivot, offset;
+		float size;
+		Palette palette;
+
+		std::string text;
+		bool hasNumber = false;
+		size_t number = 0;
+
+		bool dirty = true;
+		GLuint displayList = 0;
+		float width = 0.0f;
+		size_t cells = 0;
+
+		void compileList()
+		{
+			if (displayList == 0)
+				displayList = glGenLists(1);
+
+			const glm::vec3 &color = PALETTE_SHADES[palette][FACE_FRONT];
+			width = 0.0f;
+			cells = 0;
+
+			glNewList(displayList, GL_COMPILE);
+			glBegin(GL_TRIANGLES);
+			glColor4f(color.x, color.y, color.z, 1.0f);
+			for (char c : text)
+			{
+				const Glyph *glyph = findGlyph(c);
+				if (glyph == nullptr)
+					continue;
+
+				size_t glyphWidth = std::strlen(glyph->rows[0]);
+				for (size_t row = 0; row < GLYPH_HEIGHT; ++row)
+				{
+					float y = static_cast<float>(GLYPH_HEIGHT - 1 - row);
+					for (size_t column = 0; column < glyphWidth; ++column)
+					{
+						if (glyph->rows[row][column] != '#')
+							continue;
+
+						// Clockwise like the cubes
+						float x = width + static_cast<float>(column);
+						glVertex2f(x, y + 1.0f);
+						glVertex2f(x + 1.0f, y + 1.0f);
+						glVertex2f(x + 1.0f, y);
+
+						glVertex2f(x, y + 1.0f);
+						glVertex2f(x + 1.0f, y);
+						glVertex2f(x, y);
+						++cells;
+					}
+				}
+				width += static_cast<float>(glyphWidth + 1);
+			}
+			glEnd();
+			glEndList();
+
+			// No spacing after the last glyph
+			if (width > 0.0f)
+				width -= 1.0f;
+			dirty = false;
+		}
+	};
+
+	// A local player: their snake, orbit camera, part of the window and scores. All players share one field.
+	struct Player
+	{
+		Player(Field &field, size_t index)
+			: snake(field), index(index),
+			  scoreText({ 0.0f, 0.0f }, { 0.0f, 0.0f }, { +1.0f, +1.0f }, 1.0f / 60.0f, PALETTE_TEXT),
+			  bestScoreText({ 1.0f, 0.0f }, { 1.0f, 0.0f }, { -1.0f, +1.0f }, 1.0f / 60.0f, PALETTE_TEXT)
+		{
+			snake.setSpawn(PLAYER_SPAWNS[index]);
+			snake.reset(PLAYER_SPAWNS[index]);
+		}
+
+		Snake snake;
+		size_t index;
+		glm::vec3 sphericalCoords = DEFAULT_SPHERICAL_COORDS;
+		Viewport viewport;
+		HudText scoreText, bestScoreText;
+	};
+
+	// Everything needed to simulate a recorded game again: the field seed, the spawn and the requested directions.
+	struct Replay
+	{
+		struct Input
+		{
+			uint32_t tick;
+			glm::vec3 direction;
+		};
+
+		unsigned int seed = 0;
+		glm::vec3 spawn;
+		uint32_t ticks = 0;
+		std::vector<Input> inputs;
+	};
+
+	// Shortest distance between two cells when leaving the field on one side enters it on the other
+	template<size_t W, size_t H, size_t D>
+	float wrappedDistance(const glm::vec3 &a, const glm::vec3 &b)
+	{
+		const float sizes[3] = { static_cast<float>(W), static_cast<float>(H), static_cast<float>(D) };
+		float distance = 0.0f;
+		for (int i = 0; i < 3; ++i)
+		{
+			float d = glm::abs(a[i] - b[i]);
+			distance += std::min(d, sizes[i] - d);
+		}
+		return distance;
+	}
+
+	// Steers towards the food and avoids running into itself, sometimes takes a random safe turn instead.
+	template<size_t W, size_t H, size_t D>
+	glm::vec3 autopilot(const BasicSnake<W, H, D> &snake, const BasicField<W, H, D> &field, std::default_random_engine &random)
+	{
+		static const glm::vec3 DIRECTIONS[6] = {
+			{ +1.0f, +0.0f, +0.0f }, { -1.0f, +0.0f, +0.0f },
+			{ +0.0f, +1.0f, +0.0f }, { +0.0f, -1.0f, +0.0f },
+			{ +0.0f, +0.0f, +1.0f }, { +0.0f, +0.0f, -1.0f }
+		};
+
+		size_t safe[6];
+		size_t safeCount = 0;
+		size_t best = 0;
+		float bestDistance = 0.0f;
+		for (size_t d = 0; d < 6; ++d)
+		{
+			// The snake ignores requests to reverse
+			if (DIRECTIONS[d] + snake.getDirection() == glm::vec3())
+				continue;
+
+			glm::vec3 next = BasicSnake<W, H, D>::wrap(snake.getHeadPos() + DIRECTIONS[d]);
+			if (snake.collides(next))
+				continue;
+
+			float distance = wrappedDistance<W, H, D>(next, field.getFood());
+			if (safeCount == 0 || distance < bestDistance)
+			{
+				best = d;
+				bestDistance = distance;
+			}
+			safe[safeCount++] = d;
+		}
+
+		if (safeCount == 0)
+			return snake.getDirection();
+		if (Randomf::randomInt(random, 0, 9) == 0)
+			return DIRECTIONS[safe[Randomf::randomInt(random, 0, static_cast<int>(safeCount) - 1)]];
+		return DIRECTIONS[best];
+	}
+
+	// Plays a game with the autopilot and records its inputs
+	Replay recordBotGame(unsigned int seed, uint32_t ticks)
+	{
+		std::default_random_engine random(seed);
+
+		Replay replay;
+		replay.seed = seed;
+		replay.ticks = ticks;
+		replay.spawn = glm::vec3(
+			static_cast<float>(Randomf::randomInt(random, 0, FIELD_WIDTH - 1)),
+			static_cast<float>(Randomf::randomInt(random, 0, FIELD_HEIGHT - 1)),
+			static_cast<float>(Randomf::randomInt(random, 0, FIELD_DEPTH - 1)));
+
+		Field field(seed);
+		Snake snake(field);
+		snake.setSpawn(replay.spawn);
+		snake.reset(replay.spawn);
+
+		glm::vec3 requested = snake.getDirection();
+		for (uint32_t tick = 0; tick < ticks; ++tick)
+		{
+			glm::vec3 direction = autopilot(snake, field, random);
+			if (direction != requested)
+			{
+				replay.inputs.push_back({ tick, direction });
+				requested = direction;
+			}
+			snake.setDirection(direction);
+			snake.update();
+		}
+		return replay;
+	}
+
+	// Plays many replays at once as translucent ghosts, every ghost simulates its own field.
+	// All ghost cubes of a tick are uploaded together and drawn with one instanced draw per viewport.
+	class GhostSet
+	{
+	public:
+		constexpr static uint32_t REPLAY_TICKS = 1500;
+
+		GhostSet() = default;
+		GhostSet(const GhostSet &) = delete;
+		GhostSet &operator=(const GhostSet &) = delete;
+
+		// Records count bot games on the job workers and starts playing them.
+		// Replays and ghosts are created by the worker that later updates their batch, see update.
+		void generate(size_t count, unsigned int seed)
+		{
+			size_t first = replays.size();
+			replays.resize(first + count);
+			Jobs::parallelFor(replays.size(), UPDATE_BATCH_SIZE, [&](size_t begin, size_t end)
+			{
+				for (size_t i = std::max(begin, first); i < end; ++i)
+					replays[i] = recordBotGame(seed + static_cast<unsigned int>(i - first), REPLAY_TICKS);
+			}, true);
+
+			// Ghosts point into replays, so they are only created once it does not grow anymore
+			ghosts.clear();
+			ghosts.resize(replays.size());
+			Jobs::parallelFor(ghosts.size(), UPDATE_BATCH_SIZE, [this](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+					ghosts[i].reset(new Ghost(replays[i]));
+			}, true);
+
+			// Spread the hues, vary the alpha a little
+			tints.resize(ghosts.size() * 4);
+			for (size_t i = 0; i < ghosts.size(); ++i)
+			{
+				float hue = std::fmod(static_cast<float>(i) * 0.618034f, 1.0f) * 6.0f;
+				glm::vec3 rgb(
+					glm::clamp(glm::abs(hue - 3.0f) - 1.0f, 0.0f, 1.0f),
+					glm::clamp(2.0f - glm::abs(hue - 2.0f), 0.0f, 1.0f),
+					glm::clamp(2.0f - glm::abs(hue - 4.0f), 0.0f, 1.0f));
+				rgb = glm::vec3(0.35f) + rgb * 0.65f;
+
+				tints[i * 4 + 0] = static_cast<uint8_t>(rgb.x * 255.0f);
+				tints[i * 4 + 1] = static_cast<uint8_t>(rgb.y * 255.0f);
+				tints[i * 4 + 2] = static_cast<uint8_t>(rgb.z * 255.0f);
+				tints[i * 4 + 3] = static_cast<uint8_t>(48 + (i * 37) % 48);
+			}
+			tintsDirty = true;
+			collect();
+		}
+
+		size_t size() const
+		{
+			return ghosts.size();
+		}
+
+		// Advances every ghost by one tick, a finished replay starts over.
+		// Batches of ghosts are simulated and collected on the job workers, every ghost only touches its own field.
+		// A batch goes to the same worker every tick, so with pinned workers its ghosts stay in local memory.
+		void update()
+		{
+			size_t batchCount = (ghosts.size() + UPDATE_BATCH_SIZE - 1) / UPDATE_BATCH_SIZE;
+			batchCubes.resize(batchCount);
+			Jobs::parallelFor(ghosts.size(), UPDATE_BATCH_SIZE, [this](size_t begin, size_t end)
+			{
+				PROFILE_ZONE("ghost batch");
+				for (size_t i = begin; i < end; ++i)
+				{
+					std::unique_ptr<Ghost> &ghost = ghosts[i];
+					if (ghost->tick == ghost->replay.ticks)
+						ghost.reset(new Ghost(ghost->replay));
+					ghost->update();
+				}
+				collect(begin, end, batchCubes[begin / UPDATE_BATCH_SIZE]);
+			}, true);
+
+			cubes.clear();
+			for (const std::vector<uint32_t> &batch : batchCubes)
+				cubes.insert(cubes.end(), batch.begin(), batch.end());
+			cubesDirty = true;
+		}
+
+		// Uploads the cubes of the last tick if needed and draws them between GhostRenderer::begin and end
+		void draw()
+		{
+			if (ghosts.empty())
+				return;
+
+			if (cubeBuffer == 0)
+			{
+				GLExt::GenBuffers(1, &cubeBuffer);
+				GLExt::GenBuffers(1, &tintBuffer);
+				glGenTextures(1, &cubeTexture);
+				glGenTextures(1, &tintTexture);
+			}
+
+			if (tintsDirty)
+			{
+				RenderStats::bindBuffer(GL_TEXTURE_BUFFER, tintBuffer);
+				GLExt::BufferData(GL_TEXTURE_BUFFER, tints.size(), tints.data(), GL_STATIC_DRAW);
+				RenderStats::bindBuffer(GL_TEXTURE_BUFFER, 0);
+				RenderStats::bindTexture(GL_TEXTURE_BUFFER, tintTexture);
+				GLExt::TexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, tintBuffer);
+				RenderStats::bindTexture(GL_TEXTURE_BUFFER, 0);
+				RenderStats::upload(tints.size());
+				tintsDirty = false;
+			}
+
+			if (cubesDirty)
+			{
+				size_t bytes = cubes.size() * sizeof(uint32_t);
+				RenderStats::bindBuffer(GL_TEXTURE_BUFFER, cubeBuffer);
+				if (bytes > cubeBufferCapacity)
+				{
+					cubeBufferCapacity = std::max<size_t>(bytes * 2, 64);
+					GLExt::BufferData(GL_TEXTURE_BUFFER, cubeBufferCapacity, nullptr, GL_STREAM_DRAW);
+
+					RenderStats::bindTexture(GL_TEXTURE_BUFFER, cubeTexture);
+					GLExt::TexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, cubeBuffer);
+					RenderStats::bindTexture(GL_TEXTURE_BUFFER, 0);
+				}
+				GLExt::BufferSubData(GL_TEXTURE_BUFFER, 0, bytes, cubes.data());
+				RenderStats::bindBuffer(GL_TEXTURE_BUFFER, 0);
+				RenderStats::upload(bytes);
+				cubesDirty = false;
+			}
+
+			GhostRenderer::draw(cubeTexture, tintTexture, cubes.size() / 2);
+		}
+
+	private:
+		struct Ghost
+		{
+			explicit Ghost(const Replay &replay)
+				: field(replay.seed), snake(field), replay(replay)
+			{
+				snake.setSpawn(replay.spawn);
+				snake.reset(replay.spawn);
+			}
+
+			void update()
+			{
+				while (nextInput < replay.inputs.size() && replay.inputs[nextInput].tick == tick)
+					snake.setDirection(replay.inputs[nextInput++].direction);
+				snake.update();
+				++tick;
+			}
+
+			Field field;
+			Snake snake;
+			const Replay &replay;
+			size_t nextInput = 0;
+			uint32_t tick = 0;
+		};
+
+		constexpr static size_t UPDATE_BATCH_SIZE = 64;
+
+		std::vector<Replay> replays;
+		std::vector<std::unique_ptr<Ghost>> ghosts;
+
+		// Pairs of cell index and ghost index, batchCubes holds them per update batch
+		std::vector<uint32_t> cubes;
+		std::vector<std::vector<uint32_t>> batchCubes;
+		std::vector<uint8_t> tints;
+		bool cubesDirty = true;
+		bool tintsDirty = true;
+
+		GLuint cubeBuffer = 0, cubeTexture = 0;
+		GLuint tintBuffer = 0, tintTexture = 0;
+		size_t cubeBufferCapacity = 0;
+
+		void collect(size_t begin, size_t end, std::vector<uint32_t> &out) const
+		{
+			out.clear();
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Snake &snake = ghosts[i]->snake;
+				for (size_t p = 0; p < snake.getLength(); ++p)
+				{
+					const glm::vec3 &cell = snake.getPart(p);
+					out.push_back(static_cast<uint32_t>(cell.x + FIELD_WIDTH * (cell.y + FIELD_HEIGHT * cell.z)));
+					out.push_back(static_cast<uint32_t>(i));
+				}
+			}
+		}
+
+		void collect()
+		{
+			collect(0, ghosts.size(), cubes);
+			cubesDirty = true;
+		}
+	};
 
-		GLFWimage icon{ static_cast<int>(ICON_WIDTH), static_cast<int>(ICON_HEIGHT), pixels.data() };
+	// Emits the lines that mark the row, column and pillar of the snake head into a GL_LINES block
+	void drawDirectionBorders(const glm::vec3 &headPos, Palette palette)
+	{
+		const glm::vec3 &c = PALETTE_COLORS[palette];
+		glColor4f(c.x, c.y, c.z, 0.1f);
+		RenderStats::immediate(24, 1);
 
-		for (size_t y = 0; y < ICON_HEIGHT; ++y)
+		auto hp = headPos + glm::vec3(CUBE_SIZE_H);
+
+		// x dir
 		{
-			for (size_t x = 0; x < ICON_WIDTH; ++x)
+			glm::vec4 v0b = transformPosition4({ 0.0f, hp.y - CUBE_SIZE_H, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v1b = transformPosition4({ +FIELD_WIDTH_F, hp.y - CUBE_SIZE_H, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v2b = transformPosition4({ +FIELD_WIDTH_F, hp.y - CUBE_SIZE_H, hp.z + CUBE_SIZE_H, 1.0f });
+			glm::vec4 v3b = transformPosition4({ 0.0f, hp.y - CUBE_SIZE_H, hp.z + CUBE_SIZE_H, 1.0f });
+
+			glm::vec4 v0t = transformPosition4({ 0.0f, hp.y + CUBE_SIZE_H, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v1t = transformPosition4({ +FIELD_WIDTH_F, hp.y + CUBE_SIZE_H, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v2t = transformPosition4({ +FIELD_WIDTH_F, hp.y + CUBE_SIZE_H, hp.z + CUBE_SIZE_H, 1.0f });
+			glm::vec4 v3t = transformPosition4({ 0.0f, hp.y + CUBE_SIZE_H, hp.z + CUBE_SIZE_H, 1.0f });
+
+			glVertex4fv(&v0b[0]);
+			glVertex4fv(&v1b[0]);
+
+			glVertex4fv(&v2b[0]);
+			glVertex4fv(&v3b[0]);
+
+			glVertex4fv(&v0t[0]);
+			glVertex4fv(&v1t[0]);
+
+			glVertex4fv(&v2t[0]);
+			glVertex4fv(&v3t[0]);
+		}
+
+		// y dir
+		{
+			glm::vec4 v0b = transformPosition4({ hp.x - CUBE_SIZE_H, 0.0f, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v1b = transformPosition4({ hp.x + CUBE_SIZE_H, 0.0f, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v2b = transformPosition4({ hp.x + CUBE_SIZE_H, 0.0f, hp.z + CUBE_SIZE_H, 1.0f });
+			glm::vec4 v3b = transformPosition4({ hp.x - CUBE_SIZE_H, 0.0f, hp.z + CUBE_SIZE_H, 1.0f });
+
+			glm::vec4 v0t = transformPosition4({ hp.x - CUBE_SIZE_H, +FIELD_HEIGHT_F, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v1t = transformPosition4({ hp.x + CUBE_SIZE_H, +FIELD_HEIGHT_F, hp.z - CUBE_SIZE_H, 1.0f });
+			glm::vec4 v2t = transformPosition4({ hp.x + CUBE_SIZE_H, +FIELD_HEIGHT_F, hp.z + CUBE_SIZE_H, 1.0f });
+			glm::vec4 v3t = transformPosition4({ hp.x - CUBE_SIZE_H, +FIELD_HEIGHT_F, hp.z + CUBE_SIZE_H, 1.0f });
+
+			glVertex4fv(&v0b[0]);
+			glVertex4fv(&v0t[0]);
+
+			glVertex4fv(&v1b[0]);
+			glVertex4fv(&v1t[0]);
+
+			glVertex4fv(&v2b[0]);
+			glVertex4fv(&v2t[0]);
+
+			glVertex4fv(&v3b[0]);
+			glVertex4fv(&v3t[0]);
+		}
+
+		// z dir
+		{
+			glm::vec4 v0b = transformPosition4({ hp.x - CUBE_SIZE_H, hp.y - CUBE_SIZE_H, 0.0f, 1.0f });
+			glm::vec4 v1b = transformPosition4({ hp.x + CUBE_SIZE_H, hp.y - CUBE_SIZE_H, 0.0f, 1.0f });
+			glm::vec4 v2b = transformPosition4({ hp.x + CUBE_SIZE_H, hp.y - CUBE_SIZE_H, +FIELD_DEPTH_F, 1.0f });
+			glm::vec4 v3b = transformPosition4({ hp.x - CUBE_SIZE_H, hp.y - CUBE_SIZE_H, +FIELD_DEPTH_F, 1.0f });
+
+			glm::vec4 v0t = transformPosition4({ hp.x - CUBE_SIZE_H, hp.y + CUBE_SIZE_H, 0.0f, 1.0f });
+			glm::vec4 v1t = transformPosition4({ hp.x + CUBE_SIZE_H, hp.y + CUBE_SIZE_H, 0.0f, 1.0f });
+			glm::vec4 v2t = transformPosition4({ hp.x + CUBE_SIZE_H, hp.y + CUBE_SIZE_H, +FIELD_DEPTH_F, 1.0f });
+			glm::vec4 v3t = transformPosition4({ hp.x - CUBE_SIZE_H, hp.y + CUBE_SIZE_H, +FIELD_DEPTH_F, 1.0f });
+
+			glVertex4fv(&v3b[0]);
+			glVertex4fv(&v0b[0]);
+
+			glVertex4fv(&v2b[0]);
+			glVertex4fv(&v1b[0]);
+
+			glVertex4fv(&v3t[0]);
+			glVertex4fv(&v0t[0]);
+
+			glVertex4fv(&v2t[0]);
+			glVertex4fv(&v1t[0]);
+		}
+	}
+}
+
+// Sets the swap interval of the current context, returns the mode that is actually used.
+PresentMode applyPresentMode(PresentMode mode)
+{
+	switch (mode)
+	{
+	case PresentMode::AdaptiveVSync:
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			glfwSwapInterval(-1);
+			return mode;
+		}
+		Debug::clog("Adaptive vsync is not supported, using vsync.\n");
+		glfwSwapInterval(1);
+		return PresentMode::VSync;
+	case PresentMode::Uncapped:
+	case PresentMode::Capped:
+		glfwSwapInterval(0);
+		return mode;
+	case PresentMode::VSync:
+	default:
+		glfwSwapInterval(1);
+		return PresentMode::VSync;
+	}
+}
+
+#pragma region BENCHMARK_HPP
+// Headless microbenchmarks of the simulation, built instead of the game with -DSNAKE3D_BENCHMARK.
+// Every benchmark runs on arenas from 8^3 to 256^3 cells and, where the snake length matters, with snakes from one part
+// up to the full board. Results are written as JSON for regression tracking.
+namespace Benchmark
+{
+	// Hamiltonian cycle through an arena with even sides that leaving on one side enters on the other.
+	// Rows alternate their x direction, layers their y direction, and the last cell is next to the first through z.
+	// A snake following it never runs into itself, even when it fills the whole board.
+	template<size_t W, size_t H, size_t D>
+	struct Cycle
+	{
+		static_assert(W % 2 == 0 && H % 2 == 0 && D % 2 == 0, "The cycle needs even sides.");
+		constexpr static size_t SIZE = W * H * D;
+
+		static glm::vec3 cell(size_t i)
+		{
+			i %= SIZE;
+			size_t z = i / (W * H);
+			size_t row = (i % (W * H)) / W;
+			size_t column = i % W;
+			size_t y = z % 2 == 0 ? row : H - 1 - row;
+			size_t x = row % 2 == 0 ? column : W - 1 - column;
+			return glm::vec3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+		}
+
+		// Direction from cell i to the next one
+		static glm::vec3 step(size_t i)
+		{
+			glm::vec3 d = cell(i + 1) - cell(i);
+			for (int c = 0; c < 3; ++c)
 			{
-				unsigned char r, g, b;
-				if (x == BD || y == BD || x == ICON_WIDTH - BDM || y == ICON_HEIGHT - BDM)
-				{ // background
-					r = static_cast<unsigned char>(su::BG_R * 255);
-					g = static_cast<unsigned char>(su::BG_G * 255);
-					b = static_cast<unsigned char>(su::BG_B * 255);
-				}
-				else if (x < BD || y < BD || x > ICON_WIDTH - BDM || y > ICON_HEIGHT - BDM)
-				{ // empty tile
-					if (x < BD && (y > BD && y < ICON_HEIGHT - BDM))
-					{ // snake tile
-						r = static_cast<unsigned char>(su::ST_R * 255);
-						g = static_cast<unsigned char>(su::ST_G * 255);
-						b = static_cast<unsigned char>(su::ST_B * 255);
-					}
-					else if (x > ICON_WIDTH - BDM && (y > BD && y < ICON_HEIGHT - BDM))
-					{ // food tile
-						r = static_cast<unsigned char>(su::FT_R * 255);
-						g = static_cast<unsigned char>(su::FT_G * 255);
-						b = static_cast<unsigned char>(su::FT_B * 255);
-					}
-					else
-					{ // empty tile
-						r = static_cast<unsigned char>(su::ET_R * 255);
-						g = static_cast<unsigned char>(su::ET_G * 255);
-						b = static_cast<unsigned char>(su::ET_B * 255);
-					}
-				}
-				else
-				{ // snake tile
-					r = static_cast<unsigned char>(su::ST_R * 255);
-					g = static_cast<unsigned char>(su::ST_G * 255);
-					b = static_cast<unsigned char>(su::ST_B * 255);
-				}
+				if (d[c] > 1.0f)
+					d[c] = -1.0f;
+				if (d[c] < -1.0f)
+					d[c] = 1.0f;
+			}
+			return d;
+		}
+	};
+}
 
-				size_t i = (y * ICON_WIDTH + x) * ICON_DEPTH;
+#ifdef SNAKE3D_BENCHMARK
+// Counts every allocation of the benchmark build, so results can report allocations per operation
+std::atomic<uint64_t> benchmarkAllocations{ 0 };
 
-				pixels[i + 0] = r;
-				pixels[i + 1] = g;
-				pixels[i + 2] = b;
-				pixels[i + 3] = 255;
+void *operator new(size_t size)
+{
+	benchmarkAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+namespace Benchmark
+{
+	using clock = std::chrono::steady_clock;
+
+	struct Result
+	{
+		const char *name;
+		size_t arena;  // cells per side
+		size_t length; // of the snake, 0 if it does not matter
+		uint64_t iterations;
+		double seconds;
+		uint64_t allocations;
+	};
+
+	double minTime = 0.2; // seconds per benchmark, --min-time
+	std::vector<Result> results;
+	uint64_t sink = 0; // keeps results of pure functions alive
+
+	// Runs op in doubling batches until minTime passed or maxIterations ran
+	template<typename Op>
+	void measure(const char *name, size_t arena, size_t length, uint64_t maxIterations, Op op)
+	{
+		uint64_t iterations = 0, batch = 1;
+		uint64_t allocations = benchmarkAllocations.load(std::memory_order_relaxed);
+		clock::time_point start = clock::now();
+		double seconds = 0.0;
+		while (iterations < maxIterations && seconds < minTime)
+		{
+			uint64_t count = std::min(batch, maxIterations - iterations);
+			for (uint64_t i = 0; i < count; ++i)
+				op();
+			iterations += count;
+			batch *= 2;
+			seconds = std::chrono::duration<double>(clock::now() - start).count();
+		}
+		allocations = benchmarkAllocations.load(std::memory_order_relaxed) - allocations;
+
+		results.push_back({ name, arena, length, iterations, seconds, allocations });
+		std::fprintf(stderr, "%-16s %3u^3 length %9u: %12.1f ns/op\n", name, static_cast<unsigned int>(arena),
+			static_cast<unsigned int>(length), seconds * 1e9 / iterations);
+	}
+
+	template<size_t N>
+	void runArena()
+	{
+		using Field = su::BasicField<N, N, N>;
+		using Snake = su::BasicSnake<N, N, N>;
+		using Cycle = Benchmark::Cycle<N, N, N>;
+		constexpr size_t SIZE = Field::SIZE;
+		constexpr uint64_t UNLIMITED = ~uint64_t(0);
+
+		// The big arenas do not fit on the stack
+		std::unique_ptr<Field> field(new Field(1));
+		std::unique_ptr<Snake> snake(new Snake(*field));
+
+		std::vector<size_t> lengths = { 1, SIZE / 64, SIZE / 8, SIZE / 2, SIZE };
+		lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+		for (size_t length : lengths)
+		{
+			// Head at cycle index length - 1, the body trails behind it along the cycle
+			size_t headCell = length - 1;
+			auto place = [&](size_t headIndex)
+			{
+				snake->assign(length, [&](size_t i) { return Cycle::cell(headCell + SIZE - i); }, Cycle::step(headCell), headIndex);
+			};
+
+			// Food stays on the neck, so the length does not change while the snake follows the cycle
+			place(0);
+			field->setFood(snake->getHeadPos());
+			size_t next = headCell;
+			measure("snake_update", N, length, UNLIMITED, [&]()
+			{
+				snake->setDirection(Cycle::step(next++));
+				snake->update();
+				field->setFood(snake->getHeadPos());
+			});
+
+			// Asking for the tail cell scans every part, the tail is skipped as it moves away
+			place(0);
+			glm::vec3 tailCell = snake->getPart(length - 1);
+			measure("snake_collides", N, length, UNLIMITED, [&]()
+			{
+				sink += snake->collides(tailCell) ? 1 : 0;
+			});
+
+			// With the head in the middle of the part array, every grow moves half of the parts
+			place(length / 2);
+			measure("snake_grow", N, length, Snake::MAX_LENGTH - length - 1, [&]()
+			{
+				snake->grow();
+			});
+		}
+
+		measure("field_new_food", N, 0, UNLIMITED, [&]()
+		{
+			field->newFood();
+			sink += static_cast<uint64_t>(field->getFood().x);
+		});
+
+		// Whole ticks of a game steered by the autopilot, as the ghosts play
+		field.reset(new Field(1));
+		snake.reset(new Snake(*field));
+		glm::vec3 spawn(static_cast<float>(N / 2));
+		snake->setSpawn(spawn);
+		snake->reset(spawn);
+		std::default_random_engine random(1);
+		measure("game_loop", N, 0, UNLIMITED, [&]()
+		{
+			snake->setDirection(su::autopilot(*snake, *field, random));
+			snake->update();
+		});
+	}
+
+	void write(FILE *file)
+	{
+		std::fprintf(file, "{\"benchmarks\":[");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result &r = results[i];
+			double nsPerOp = r.seconds * 1e9 / r.iterations;
+			std::fprintf(file, "%s\n{\"name\":\"%s\",\"arena\":%u,\"cells\":%llu,\"length\":%u,\"iterations\":%llu,\"seconds\":%.6f,"
+				"\"ns_per_op\":%.3f,\"ops_per_second\":%.1f,\"allocations_per_op\":%.3f}",
+				i == 0 ? "" : ",", r.name, static_cast<unsigned int>(r.arena), static_cast<unsigned long long>(r.arena * r.arena * r.arena),
+				static_cast<unsigned int>(r.length), static_cast<unsigned long long>(r.iterations), r.seconds,
+				nsPerOp, r.iterations / r.seconds, static_cast<double>(r.allocations) / r.iterations);
+		}
+		std::fprintf(file, "\n]}\n");
+	}
+
+	// --out <file> (default stdout), --max-arena <cells per side>, --min-time <seconds>
+	int run(int argc, char **argv)
+	{
+		const char *outPath = nullptr;
+		size_t maxArena = 256;
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (arg == "--out" && hasValue)
+				outPath = argv[++i];
+			else if (arg == "--max-arena" && hasValue)
+				maxArena = static_cast<size_t>(std::atoi(argv[++i]));
+			else if (arg == "--min-time" && hasValue)
+				minTime = std::atof(argv[++i]);
+			else
+			{
+				std::fprintf(stderr, "Unknown or incomplete option %s.\n", arg.c_str());
+				return 1;
 			}
 		}
 
-		glfwSetWindowIcon(window, 1, &icon);
+		if (maxArena >= 8)
+			runArena<8>();
+		if (maxArena >= 16)
+			runArena<16>();
+		if (maxArena >= 32)
+			runArena<32>();
+		if (maxArena >= 64)
+			runArena<64>();
+		if (maxArena >= 128)
+			runArena<128>();
+		if (maxArena >= 256)
+			runArena<256>();
+
+		FILE *file = outPath != nullptr ? std::fopen(outPath, "w") : stdout;
+		if (file == nullptr)
+		{
+			std::fprintf(stderr, "Could not open %s.\n", outPath);
+			return 1;
+		}
+		write(file);
+		if (file != stdout)
+			std::fclose(file);
+		return 0;
 	}
+}
 #endif
+#pragma endregion
 
-	// Set window callbacks
-	glfwSetWindowPosCallback(window, windowPositionCallback);
-	glfwSetWindowSizeCallback(window, windowSizeCallback);
-	glfwSetWindowCloseCallback(window, windowCloseCallback);
-	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
-	glfwSetWindowFocusCallback(window, windowFocusCallback);
-	glfwSetWindowIconifyCallback(window, windowIconifyCallback);
-	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+// Sleeping alone overshoots by up to the scheduler granularity, so this sleeps until a margin before
+// the target and spins the rest. The margin adapts to the observed oversleep.
+class PreciseSleeper
+{
+public:
+	using clock = std::chrono::steady_clock;
 
-	// Set input callbacks
-	glfwSetMouseButtonCallback(window, mouseButtonCallback);
-	glfwSetCursorPosCallback(window, cursorPositionCallback);
-	glfwSetCursorEnterCallback(window, cursorEnterCallback);
-	glfwSetScrollCallback(window, scrollCallback);
-	glfwSetKeyCallback(window, keyCallback);
-	glfwSetCharCallback(window, charCallback);
-	glfwSetCharModsCallback(window, charModsCallback);
+	void sleepUntil(clock::time_point target)
+	{
+		clock::time_point now = clock::now();
+		clock::time_point sleepEnd = target - spinMargin;
+		if (now < sleepEnd)
+		{
+			std::this_thread::sleep_until(sleepEnd);
 
-	glfwMakeContextCurrent(0);
-}
+			clock::duration oversleep = clock::now() - sleepEnd;
+			if (oversleep > spinMargin)
+				spinMargin = std::min(oversleep, MAX_SPIN_MARGIN);
+			else
+				spinMargin -= (spinMargin - MIN_SPIN_MARGIN) / 16;
+		}
 
-AppData::~AppData()
+		while (clock::now() < target)
+			std::this_thread::yield();
+	}
+
+private:
+	const clock::duration MIN_SPIN_MARGIN = std::chrono::microseconds(200);
+	const clock::duration MAX_SPIN_MARGIN = std::chrono::milliseconds(4);
+
+	clock::duration spinMargin = std::chrono::milliseconds(1);
+};
+
+// Paces frames to a fixed rate.
+class FrameLimiter
 {
-	// Window
-	glfwDestroyWindow(window);
+public:
+	using clock = PreciseSleeper::clock;
 
-	// GLFW
-	glfwTerminate();
-}
+	void setRate(double fps)
+	{
+		period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps));
+		deadline = clock::now() + period;
+	}
 
-// Constants
-namespace su
+	void wait()
+	{
+		// Too far behind, don't try to catch up with a burst of frames
+		if (clock::now() > deadline + period)
+			deadline = clock::now();
+
+		sleeper.sleepUntil(deadline);
+		deadline += period;
+	}
+
+private:
+	PreciseSleeper sleeper;
+	clock::duration period = std::chrono::milliseconds(16);
+	clock::time_point deadline = clock::now();
+};
+
+// Starts a frame as late as possible before the next vblank, so input is sampled just in time for it.
+// Needs a vsynced present mode: the time the swap returns (after glFinish) is taken as the vblank.
+class LowLatencyScheduler
 {
-	constexpr size_t FIELD_WIDTH = 8;
-	constexpr size_t FIELD_HEIGHT = 8;
-	constexpr size_t FIELD_DEPTH = 8;
-	constexpr size_t FIELD_SIZE = FIELD_WIDTH * FIELD_HEIGHT * FIELD_DEPTH;
+public:
+	using clock = PreciseSleeper::clock;
 
-	constexpr float FIELD_WIDTH_F = static_cast<float>(FIELD_WIDTH);
-	constexpr float FIELD_HEIGHT_F = static_cast<float>(FIELD_HEIGHT);
-	constexpr float FIELD_DEPTH_F = static_cast<float>(FIELD_DEPTH);
+	void setRefreshRate(int hz)
+	{
+		refreshPeriod = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / (hz > 0 ? hz : 60)));
+	}
 
-	constexpr float FIELD_WIDTH_FH = FIELD_WIDTH_F * 0.5f;
-	constexpr float FIELD_HEIGHT_FH = FIELD_HEIGHT_F * 0.5f;
-	constexpr float FIELD_DEPTH_FH = FIELD_DEPTH_F * 0.5f;
+	// Call before sampling input
+	void waitForFrameStart()
+	{
+		clock::time_point start = lastVblank + refreshPeriod - renderCost - ApplicationSettings::LOW_LATENCY_MARGIN;
+		if (clock::now() < start)
+			sleeper.sleepUntil(start);
+		frameStart = clock::now();
+	}
 
-	constexpr static float CUBE_SIZE = 0.8f;
-	constexpr static float CUBE_SIZE_H = CUBE_SIZE * 0.5f;
-	constexpr static float CUBE_DIST = 1.0f - CUBE_SIZE;
-	constexpr static float CUBE_DIST_H = CUBE_DIST * 0.5f;
+	// Call after the frame was rendered (glFinish) and before swapping
+	void frameRendered()
+	{
+		// Jump to slower frames immediately, only recover slowly from spikes
+		clock::duration cost = clock::now() - frameStart;
+		if (cost > renderCost)
+			renderCost = cost;
+		else
+			renderCost -= (renderCost - cost) / 32;
+	}
 
-	glm::mat4 mvp;
+	// Call after the swap returned (glFinish)
+	void framePresented()
+	{
+		lastVblank = clock::now();
+	}
+
+	clock::duration getRenderCost() const
+	{
+		return renderCost;
+	}
+
+private:
+	PreciseSleeper sleeper;
+	clock::duration refreshPeriod = std::chrono::microseconds(16667);
+	clock::duration renderCost = std::chrono::milliseconds(2);
+	clock::time_point frameStart = clock::now();
+	clock::time_point lastVblank = clock::now();
+};
+
+// Game time in integer nanoseconds, derived from the real clock (Event::now) through an anchor point that moves
+// whenever the clock is paused, resumed or scaled. Tick n is due at exactly n * period game time, so nothing
+// accumulates no matter how long the session runs. The scale is a fraction with a fixed denominator to stay exact.
+class GameClock
+{
+public:
+	constexpr static int64_t SCALE_DENOMINATOR = 1000;
+	constexpr static double MIN_SCALE = 1.0 / SCALE_DENOMINATOR; // smaller factors would round to a stopped clock
+	constexpr static double MAX_SCALE = 1000.0;
+
+	explicit GameClock(int64_t period)
+		: period(period)
+	{
+
+	}
+
+	// Game time 0 is now, the first tick is due one period later
+	void start(int64_t realNow)
+	{
+		anchorReal = realNow;
+		anchorGame = 0;
+		nextTick = 1;
+	}
+
+	int64_t gameTime(int64_t realNow) const
+	{
+		if (paused)
+			return anchorGame;
+
+		// Split at the denominator, elapsed * scale alone overflows after 2.5 hours at 1000x
+		int64_t elapsed = realNow - anchorReal;
+		return anchorGame + elapsed / SCALE_DENOMINATOR * scale + elapsed % SCALE_DENOMINATOR * scale / SCALE_DENOMINATOR;
+	}
 
-	inline glm::vec4 transformPosition4(const glm::vec4 &pos)
+	// Real time at which the game time is reached if the clock keeps running as it does
+	int64_t realTime(int64_t game) const
 	{
-		return static_cast<glm::vec4>(mvp * pos);
+		if (paused)
+			return anchorReal;
+
+		int64_t elapsed = game - anchorGame;
+		return anchorReal + elapsed / scale * SCALE_DENOMINATOR + elapsed % scale * SCALE_DENOMINATOR / scale;
 	}
 
-	void drawCube(const glm::vec3 &p, const glm::vec3 &c)
+	void pause(int64_t realNow)
 	{
-		glm::vec4 v0t = transformPosition4({ p.x - CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
-		glm::vec4 v1t = transformPosition4({ p.x + CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
-		glm::vec4 v2t = transformPosition4({ p.x + CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
-		glm::vec4 v3t = transformPosition4({ p.x - CUBE_SIZE_H, p.y + CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
-				
-		glm::vec4 v0b = transformPosition4({ p.x - CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
-		glm::vec4 v1b = transformPosition4({ p.x + CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z - CUBE_SIZE_H, 1.0f });
-		glm::vec4 v2b = transformPosition4({ p.x + CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
-		glm::vec4 v3b = transformPosition4({ p.x - CUBE_SIZE_H, p.y - CUBE_SIZE_H, p.z + CUBE_SIZE_H, 1.0f });
+		if (paused)
+			return;
 
-		glm::vec3 cf0 = c * 0.9f;
-		glm::vec3 cf1 = c * 0.85f;
-		glm::vec3 cf2 = c * 0.8f;
-		glm::vec3 cb0 = c * 0.5f;
-		glm::vec3 cb1 = c * 0.45f;
-		glm::vec3 cb2 = c * 0.4f;
+		rebase(realNow);
+		paused = true;
+	}
 
-		// Top tile
-		glColor3fv(&cf0[0]);
-		glVertex4fv(&v0t[0]);
-		glVertex4fv(&v1t[0]);
-		glVertex4fv(&v2t[0]);
+	void resume(int64_t realNow)
+	{
+		if (!paused)
+			return;
 
-		glVertex4fv(&v2t[0]);
-		glVertex4fv(&v3t[0]);
-		glVertex4fv(&v0t[0]);
+		anchorReal = realNow;
+		paused = false;
+	}
 
-		// Bottom Tile
-		glColor3fv(&cb2[0]);
-		glVertex4fv(&v2b[0]);
-		glVertex4fv(&v1b[0]);
-		glVertex4fv(&v0b[0]);
+	bool isPaused() const
+	{
+		return paused;
+	}
 
-		glVertex4fv(&v0b[0]);
-		glVertex4fv(&v3b[0]);
-		glVertex4fv(&v2b[0]);
+	// 1.0 is real time, the factor is rounded to thousandths and clamped to [MIN_SCALE, MAX_SCALE]
+	void setScale(double factor, int64_t realNow)
+	{
+		rebase(realNow);
+		if (factor < MIN_SCALE)
+			factor = MIN_SCALE;
+		else if (factor > MAX_SCALE)
+			factor = MAX_SCALE;
+		scale = std::max<int64_t>(1, static_cast<int64_t>(factor * SCALE_DENOMINATOR + 0.5));
+	}
 
-		// Front tile
-		glColor3fv(&cf1[0]);
-		glVertex4fv(&v3t[0]);
-		glVertex4fv(&v2t[0]);
-		glVertex4fv(&v2b[0]);
+	double getScale() const
+	{
+		return static_cast<double>(scale) / SCALE_DENOMINATOR;
+	}
 
-		glVertex4fv(&v2b[0]);
-		glVertex4fv(&v3b[0]);
-		glVertex4fv(&v3t[0]);
+	// Game time tick is due at
+	int64_t tickTime(uint64_t tick) const
+	{
+		return static_cast<int64_t>(tick) * period;
+	}
 
-		// Back tile
-		glColor3fv(&cb1[0]);
-		glVertex4fv(&v1b[0]);
-		glVertex4fv(&v1t[0]);
-		glVertex4fv(&v0t[0]);
+	// Returns whether the next tick is due and advances to the one after it
+	bool nextTickDue(int64_t realNow, uint64_t &tick)
+	{
+		if (gameTime(realNow) < tickTime(nextTick))
+			return false;
 
-		glVertex4fv(&v0t[0]);
-		glVertex4fv(&v0b[0]);
-		glVertex4fv(&v1b[0]);
+		tick = nextTick++;
+		return true;
+	}
 
-		// Right tile
-		glColor3fv(&cf2[0]);
-		glVertex4fv(&v2t[0]);
-		glVertex4fv(&v1t[0]);
-		glVertex4fv(&v1b[0]);
+private:
+	int64_t period;
+	int64_t anchorReal = 0;
+	int64_t anchorGame = 0;
+	int64_t scale = SCALE_DENOMINATOR;
+	uint64_t nextTick = 1;
+	bool paused = false;
+
+	void rebase(int64_t realNow)
+	{
+		anchorGame = gameTime(realNow);
+		anchorReal = realNow;
+	}
+};
 
-		glVertex4fv(&v1b[0]);
-		glVertex4fv(&v2b[0]);
-		glVertex4fv(&v2t[0]);
+// Time from an event in the GLFW callback until something happened in reaction to it.
+struct LatencyStats
+{
+	double sum = 0.0;
+	double max = 0.0;
+	uint64_t count = 0;
 
-		// Left tile
-		glColor3fv(&cb0[0]);
-		glVertex4fv(&v0b[0]);
-		glVertex4fv(&v0t[0]);
-		glVertex4fv(&v3t[0]);
-		
-		glVertex4fv(&v3t[0]);
-		glVertex4fv(&v3b[0]);
-		glVertex4fv(&v0b[0]);
+	void add(double latency)
+	{
+		sum += latency;
+		max = std::max(max, latency);
+		++count;
 	}
 
-	class Field
+	void report(const char *name) const
 	{
-	public:
-		constexpr static size_t MAX_OBSTACLES = FIELD_SIZE + 5;
+		if (count == 0)
+			return;
 
-		Field()
-		{
-			Randomf::seed();
-			newFood();
-		}
-		
-		void draw() const
-		{
-			drawCube(food + glm::vec3(CUBE_SIZE_H), { su::FT_R, su::FT_G, su::FT_B });
-		}
+		Debug::clog(name, " latency: avg ", sum / count * 1000.0, " ms, max ", max * 1000.0, " ms (", count, " samples)\n");
+	}
+};
 
-		constexpr size_t getWidth() const
-		{
-			return FIELD_WIDTH;
-		}
+#pragma region RENDER_BENCHMARK_HPP
+// Renders scripted scenes for a fixed number of frames each, on every available render path, while the camera
+// circles the board on a fixed path. Reports frame time percentiles and how much of it the CPU and the GPU took:
+// CPU time runs from the frame start until the swap is issued, GPU time is measured with GL_TIME_ELAPSED queries.
+namespace RenderBenchmark
+{
+	constexpr size_t WARMUP_FRAMES = 30;
+	constexpr size_t QUERY_COUNT = 8;     // frames the GPU may lag behind before a query result is waited for
+	constexpr size_t HEAVY_HUD_LINES = 32;
+	constexpr size_t LARGE_ARENA = 64;
 
-		constexpr size_t getHeight() const
-		{
-			return FIELD_HEIGHT;
-		}
+	struct Percentiles
+	{
+		double p50 = 0.0, p95 = 0.0, p99 = 0.0; // ms
+	};
 
-		const glm::vec3 &getFood() const
-		{
-			return food;
-		}
+	Percentiles percentiles(std::vector<double> &samples)
+	{
+		Percentiles result;
+		if (samples.empty())
+			return result;
 
-		void newFood()
+		std::sort(samples.begin(), samples.end());
+		auto percentile = [&](double p)
 		{
-			int x = Randomf::randomInt(0, FIELD_WIDTH - 1);
-			int y = Randomf::randomInt(0, FIELD_HEIGHT - 1);
-			int z = Randomf::randomInt(0, FIELD_DEPTH - 1);
+			return samples[static_cast<size_t>(p * (samples.size() - 1))];
+		};
+		result.p50 = percentile(0.5);
+		result.p95 = percentile(0.95);
+		result.p99 = percentile(0.99);
+		return result;
+	}
 
-			food.x = static_cast<float>(x);
-			food.y = static_cast<float>(y);
-			food.z = static_cast<float>(z);
-		}
+	struct Scene
+	{
+		const char *name;
+		size_t arena;         // cells per side
+		su::CubeBatch *batch; // built once, only the camera moves
+		size_t hudLines;      // texts that change every frame
+	};
 
-	private:
-		//std::array<glm::vec2, MAX_OBSTACLES> obstacles;
-		glm::vec3 food;
+	struct Result
+	{
+		const char *scene;
+		su::RenderPath path;
+		size_t arena;
+		size_t cubes;
+		size_t frames;
+		Percentiles frame, cpu, gpu;
+		bool gpuTimed;
+		double drawCalls; // per frame
+		double triangles;
 	};
 
+	const char *RENDER_PATH_NAMES[static_cast<int>(su::RenderPath::Count)] = { "immediate", "vertex_pulling", "raymarch" };
 
-	class Snake
+	// Ring of timer queries, each result is read QUERY_COUNT frames after its query ended so reading does not stall
+	class GpuTimer
 	{
 	public:
-		using pos_t = glm::vec3;
-		using part_t = pos_t;
-
-		Snake(Field &field)
-			: field(field)
+		GpuTimer()
 		{
+			if (GLExt::timerQueries)
+				GLExt::GenQueries(static_cast<GLsizei>(QUERY_COUNT), queries.data());
+		}
 
+		~GpuTimer()
+		{
+			if (GLExt::timerQueries)
+				GLExt::DeleteQueries(static_cast<GLsizei>(QUERY_COUNT), queries.data());
 		}
 
-		constexpr static size_t MAX_LENGTH = FIELD_SIZE + 5;
+		GpuTimer(const GpuTimer &) = delete;
+		GpuTimer &operator=(const GpuTimer &) = delete;
 
-		void setDirection(const pos_t &dir)
+		void begin()
 		{
-			this->rdir = dir;
+			if (!GLExt::timerQueries)
+				return;
+
+			if (pending == QUERY_COUNT)
+				read();
+			GLExt::BeginQuery(GL_TIME_ELAPSED, queries[(first + pending) % QUERY_COUNT]);
 		}
 
-		void reset(const pos_t &position)
+		void end()
 		{
-			for (size_t i = 0; i < getLength(); ++i)
-			{
-				parts[i] = position;
-			}
-			head = 0;
-			tail = 0;
+			if (!GLExt::timerQueries)
+				return;
+
+			GLExt::EndQuery(GL_TIME_ELAPSED);
+			++pending;
 		}
 
-		size_t leftIndex(size_t index)
+		// Waits for the remaining results and hands over all times in ms
+		void finish(std::vector<double> &out)
 		{
-			if (index == 0)
-				return length - 1;
-			return index - 1;
+			while (pending > 0)
+				read();
+			out.swap(times);
+			times.clear();
 		}
 
-		size_t rightIndex(size_t index)
+	private:
+		std::array<GLuint, QUERY_COUNT> queries;
+		size_t first = 0, pending = 0;
+		std::vector<double> times;
+
+		void read()
 		{
-			if (index == length - 1)
-				return 0;
-			return index + 1;
+			uint64_t ns = 0;
+			GLExt::GetQueryObjectui64v(queries[first], GL_QUERY_RESULT, &ns);
+			times.push_back(ns * 1e-6);
+			first = (first + 1) % QUERY_COUNT;
+			--pending;
 		}
+	};
 
-		void grow()
-		{
-			//    H 1 T
-			// -> H 1 2 T
+	// Snake along the cycle of the arena, the head at cell count - 1 and the food on the cell in front of it
+	template<size_t N>
+	void buildScene(su::CubeBatch &batch, size_t length, unsigned int seed)
+	{
+		using Cycle = Benchmark::Cycle<N, N, N>;
+		std::unique_ptr<su::BasicField<N, N, N>> field(new su::BasicField<N, N, N>(seed));
+		std::unique_ptr<su::BasicSnake<N, N, N>> snake(new su::BasicSnake<N, N, N>(*field));
 
-			//    1 T H
-			// -> 1 2 T H
+		if (length > 0)
+		{
+			snake->assign(length, [&](size_t i) { return Cycle::cell(length - 1 - i); }, Cycle::step(length - 1));
+			field->setFood(Cycle::cell(length));
+		}
 
-			//    T H 1
-			// -> 2 T H 1
+		batch.clear();
+		field->draw(batch);
+		if (length > 0)
+			snake->draw(batch);
+	}
 
-			// push tail sequence to the right and insert tail at old tail
-			// move head to right except if head is zero, then the head is on the tails left side
-			// Implementation: copy objects from left to right starting from the right side moving towards the tail (left) -> tail is dublicated automatically
+	// Renders every scene on every path into the window with a current context, events is drained like the game does.
+	// Returns false if the window was closed before the end.
+	bool run(GLFWwindow *window, EventQueue &events, float width, float height, size_t frames, std::vector<Result> &results)
+	{
+		// Same state as the game
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_CULL_FACE);
+		glFrontFace(GL_CW);
+		glClearColor(su::BG_R, su::BG_G, su::BG_B, 1.0f);
+
+		// Scenes are built before anything is timed, the 64^3 snake alone has about 200k cubes
+		su::CubeBatch emptyBatch(su::FIELD_WIDTH, su::FIELD_HEIGHT, su::FIELD_DEPTH);
+		su::CubeBatch halfBatch(su::FIELD_WIDTH, su::FIELD_HEIGHT, su::FIELD_DEPTH);
+		su::CubeBatch fullBatch(su::FIELD_WIDTH, su::FIELD_HEIGHT, su::FIELD_DEPTH);
+		su::CubeBatch largeBatch(LARGE_ARENA, LARGE_ARENA, LARGE_ARENA);
+		buildScene<su::FIELD_WIDTH>(emptyBatch, 0, 1);
+		buildScene<su::FIELD_WIDTH>(halfBatch, su::Field::SIZE / 2, 1);
+		buildScene<su::FIELD_WIDTH>(fullBatch, su::Field::SIZE - 1, 1);
+		buildScene<LARGE_ARENA>(largeBatch, LARGE_ARENA * LARGE_ARENA * LARGE_ARENA * 3 / 4, 1);
+
+		const Scene scenes[] = {
+			{ "empty", su::FIELD_WIDTH, &emptyBatch, 0 },
+			{ "half_board", su::FIELD_WIDTH, &halfBatch, 0 },
+			{ "full_board", su::FIELD_WIDTH, &fullBatch, 0 },
+			{ "long_snake", LARGE_ARENA, &largeBatch, 0 },
+			{ "heavy_hud", su::FIELD_WIDTH, &halfBatch, HEAVY_HUD_LINES },
+		};
 
-			size_t index = length;
-			while (index != tail)
-			{
-				parts[index] = parts[index - 1];
-				--index;
-			}
-			++length;
-			++tail;
-			if(head > 0)
-				++head;
+		su::HudText titleText({ 0.5f, 1.0f }, { 0.5f, 1.0f }, { 0.0f, -2.0f }, 1.0f / 60.0f, su::PALETTE_TEXT);
+		titleText.set("SNAKE3D");
+		std::vector<su::HudText> hudTexts;
+		for (size_t i = 0; i < HEAVY_HUD_LINES; ++i)
+			hudTexts.emplace_back(glm::vec2(0.0f, 1.0f), glm::vec2(0.0f, 1.0f), glm::vec2(+1.0f, -1.0f - 7.0f * i), 1.0f / 150.0f, su::PALETTE_TEXT);
 
-			if (length > bestLength)
-				bestLength = length;
-		}
+		GpuTimer gpuTimer;
+		std::vector<Event> eventBatch;
+		eventBatch.reserve(EventQueue::CAPACITY);
+		std::vector<double> frameTimes, cpuTimes, gpuTimes;
 
-		void update()
+		for (const Scene &scene : scenes)
 		{
-			// Just change if direction is not the opposite
-			if (this->cdir + rdir != pos_t())
-				this->cdir = rdir;
-
-			// Last part to new first part
-			// Implementation: index magic, as this is not a dynamic list
+			// The raymarcher only knows the 8^3 board
+			if (scene.arena == su::FIELD_WIDTH)
+				su::Raymarcher::update(*scene.batch);
 
-			pos_t newPos = parts[head];
-			newPos += cdir;
-
-			if (newPos.x < 0.0f)
-				newPos.x = FIELD_WIDTH - 1;
-			if (newPos.x > FIELD_WIDTH - 1)
-				newPos.x = 0.0f;
-			
-			if (newPos.y < 0.0f)
-				newPos.y = FIELD_HEIGHT - 1;
-			if (newPos.y > FIELD_HEIGHT - 1)
-				newPos.y = 0.0f;
-
-			if (newPos.z < 0.0f)
-				newPos.z = FIELD_DEPTH - 1;
-			if (newPos.z > FIELD_DEPTH - 1)
-				newPos.z = 0.0f;
-
-			// Check if new position is deadly
-			for (size_t i = 0; i < length; ++i)
+			for (int p = 0; p < static_cast<int>(su::RenderPath::Count); ++p)
 			{
-				if (parts[i] == newPos && i != tail) // tail does not need to be checked as it is removed with this update
+				su::RenderPath path = static_cast<su::RenderPath>(p);
+				if ((path == su::RenderPath::VertexPulling && !su::VertexPulling::available) ||
+					(path == su::RenderPath::Raymarch && (!su::Raymarcher::available || scene.arena != su::FIELD_WIDTH)))
+					continue;
+
+				float half = scene.arena * 0.5f;
+				glm::mat4 mMat = glm::translate(glm::mat4(), glm::vec3(-half, -half, -half));
+				float distance = su::DEFAULT_SPHERICAL_COORDS.z * scene.arena / su::FIELD_WIDTH;
+
+				frameTimes.clear();
+				cpuTimes.clear();
+				RenderStats::Counters counters;
+				int64_t lastFrameStart = 0;
+				for (size_t frame = 0; frame < WARMUP_FRAMES + frames; ++frame)
 				{
-					reset({1.0f, 1.0f, 1.0f});
-					length = 1;
-					return;
-				}
-			}
+					int64_t frameStart = Event::now();
+					bool timed = frame >= WARMUP_FRAMES;
+					if (timed && frame > WARMUP_FRAMES)
+						frameTimes.push_back((frameStart - lastFrameStart) * 1e-6);
+					lastFrameStart = frameStart;
+
+					events.drain(eventBatch);
+					for (const Event &e : eventBatch)
+					{
+						if (e.type == Event::Type::WindowCloseEvent)
+							return false;
+						if (e.type == Event::Type::WindowSizeEvent)
+						{
+							width = static_cast<float>(e.windowSizeEventArgs.width);
+							height = static_cast<float>(e.windowSizeEventArgs.height);
+						}
+					}
+					events.requestFlush();
+
+					// One and a half turns around the board while the elevation swings twice, the same for every run
+					float t = static_cast<float>(frame % frames) / static_cast<float>(frames);
+					glm::vec3 sphericalCoords(su::DEFAULT_SPHERICAL_COORDS.x + 0.25f * std::sin(2.0f * glm::two_pi<float>() * t),
+						su::DEFAULT_SPHERICAL_COORDS.y + 1.5f * glm::two_pi<float>() * t, distance);
+
+					if (timed)
+						gpuTimer.begin();
+					RenderStats::beginFrame();
+					RenderStats::viewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+					su::Viewport viewport;
+					viewport.width = static_cast<GLsizei>(width);
+					viewport.height = static_cast<GLsizei>(height);
+					glm::mat4 pMat = glm::perspective(glm::half_pi<float>() * 0.5f, viewport.aspect(), 0.1f, 4.0f * distance);
+					glm::mat4 vMat = glm::lookAt(su::toCartesianCoords(sphericalCoords), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+					RenderStats::beginPass(RenderStats::PASS_SCENE);
+					su::mvp = pMat * vMat * mMat;
+					if (path == su::RenderPath::Raymarch)
+						su::Raymarcher::draw(0.0f, 0.0f, width, height);
+					else
+						scene.batch->draw(path);
 
-			// Check if new position is food
-			if (field.getFood() == newPos)
-			{
-				grow();
-				field.newFood();
-			}
+					// The borders are drawn for the size of the game field
+					if (scene.arena == su::FIELD_WIDTH)
+					{
+						RenderStats::beginPass(RenderStats::PASS_LINES);
+						RenderStats::begin(GL_LINES);
+						su::drawFieldBorders();
+						RenderStats::end();
+					}
 
-			head = leftIndex(head);
-			tail = leftIndex(head);
+					RenderStats::beginPass(RenderStats::PASS_UI);
+					RenderStats::disable(GL_DEPTH_TEST);
+					titleText.draw(viewport);
+					for (size_t i = 0; i < scene.hudLines; ++i)
+					{
+						hudTexts[i].set("LINE " + std::to_string(i) + " FRAME " + std::to_string(frame) + " CUBES " + std::to_string(scene.batch->size()));
+						hudTexts[i].draw(viewport);
+					}
+					RenderStats::enable(GL_DEPTH_TEST);
+					RenderStats::endFrame();
+					if (timed)
+					{
+						gpuTimer.end();
+						cpuTimes.push_back((Event::now() - frameStart) * 1e-6);
+						counters += RenderStats::lastFrame().total();
+					}
 
-			parts[head] = newPos;
+					glfwSwapBuffers(window);
+				}
+				frameTimes.push_back((Event::now() - lastFrameStart) * 1e-6);
+				gpuTimer.finish(gpuTimes);
+
+				Result result;
+				result.scene = scene.name;
+				result.path = path;
+				result.arena = scene.arena;
+				result.cubes = scene.batch->size();
+				result.frames = frames;
+				result.frame = percentiles(frameTimes);
+				result.cpu = percentiles(cpuTimes);
+				result.gpuTimed = !gpuTimes.empty();
+				result.gpu = percentiles(gpuTimes);
+				result.drawCalls = static_cast<double>(counters.drawCalls) / frames;
+				result.triangles = static_cast<double>(counters.triangles) / frames;
+				results.push_back(result);
+
+				Debug::clog(scene.name, " (", RENDER_PATH_NAMES[p], "): frame p50 ", result.frame.p50, " ms, p99 ", result.frame.p99,
+					" ms, cpu p50 ", result.cpu.p50, " ms, gpu p50 ", result.gpuTimed ? std::to_string(result.gpu.p50) + " ms" : std::string("n/a"), '\n');
+			}
 		}
+		return true;
+	}
 
-		size_t getLength() const
+	bool write(const char *path, const std::vector<Result> &results)
+	{
+		FILE *file = std::fopen(path, "w");
+		if (file == nullptr)
 		{
-			return this->length;
+			std::fprintf(stderr, "Could not open %s for the render benchmark.\n", path);
+			return false;
 		}
 
-		size_t getBestLength() const
+		std::fprintf(file, "{\"renderer\":\"%s\",\"timer_queries\":%s,\"results\":[", reinterpret_cast<const char *>(glGetString(GL_RENDERER)),
+			GLExt::timerQueries ? "true" : "false");
+		for (size_t i = 0; i < results.size(); ++i)
 		{
-			return this->bestLength;
+			const Result &r = results[i];
+			std::fprintf(file, "%s\n{\"scene\":\"%s\",\"path\":\"%s\",\"arena\":%u,\"cubes\":%u,\"frames\":%u,\"draw_calls\":%.1f,\"triangles\":%.0f",
+				i == 0 ? "" : ",", r.scene, RENDER_PATH_NAMES[static_cast<int>(r.path)], static_cast<unsigned int>(r.arena),
+				static_cast<unsigned int>(r.cubes), static_cast<unsigned int>(r.frames), r.drawCalls, r.triangles);
+			std::fprintf(file, ",\"frame_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f}", r.frame.p50, r.frame.p95, r.frame.p99);
+			std::fprintf(file, ",\"cpu_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f}", r.cpu.p50, r.cpu.p95, r.cpu.p99);
+			if (r.gpuTimed)
+				std::fprintf(file, ",\"gpu_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f}", r.gpu.p50, r.gpu.p95, r.gpu.p99);
+			std::fprintf(file, "}");
 		}
+		std::fprintf(file, "\n]}\n");
+		std::fclose(file);
+		return true;
+	}
+}
+#pragma endregion
 
-		void draw()
+#pragma region PGO_TRAINING_HPP
+// Fixed workload for profile-guided optimization, run by the instrumented build of build.sh pgo.
+// It runs the hot paths of a game session, each for a fixed amount of work so profiles of different runs compare:
+// autoplayed games with geometry collection, snakes that fill most of the arena and keep spawning food,
+// ghost replays on the job workers, bursts of input events and, if a headless context can be created, rendering.
+namespace PgoTraining
+{
+	constexpr uint64_t GAME_TICKS = 500000;
+	constexpr uint64_t HIGH_FILL_TICKS = 50000;
+	constexpr size_t GHOSTS = 256;
+	constexpr uint64_t GHOST_TICKS = 2000;
+	constexpr size_t EVENT_BURSTS = 500;
+	constexpr size_t EVENT_BURST_SIZE = 4 * EventQueue::CAPACITY; // half of them are never merged
+	constexpr size_t RENDER_FRAMES = 120;
+	constexpr int RENDER_WIDTH = 640;
+	constexpr int RENDER_HEIGHT = 480;
+
+	// All players on one field steered by the autopilot, the batch is collected every tick like the game does
+	void trainGames()
+	{
+		su::Field field(1);
+		su::CubeBatch batch(su::FIELD_WIDTH, su::FIELD_HEIGHT, su::FIELD_DEPTH);
+		std::default_random_engine random(1);
+
+		std::vector<std::unique_ptr<su::Snake>> snakes;
+		for (size_t i = 0; i < su::MAX_PLAYERS; ++i)
 		{
-			for (size_t i = 0; i < getLength(); ++i)
-			{
-				su::drawCube(parts[i] + glm::vec3(CUBE_SIZE_H), { su::ST_R, su::ST_G, su::ST_B });
-			}
+			snakes.emplace_back(new su::Snake(field));
+			snakes[i]->setSpawn(su::PLAYER_SPAWNS[i]);
+			snakes[i]->reset(su::PLAYER_SPAWNS[i]);
 		}
 
-		const pos_t &getHeadPos() const
+		std::vector<std::vector<const su::Snake *>> opponents(snakes.size());
+		for (size_t i = 0; i < snakes.size(); ++i)
 		{
-			return parts[head];
+			for (size_t j = 0; j < snakes.size(); ++j)
+			{
+				if (i != j)
+					opponents[i].push_back(snakes[j].get());
+			}
 		}
 
-	private:
-		Field &field;
-
-		pos_t cdir = pos_t(0.0f, 1.0f, 0.0f); // current direction
-		pos_t rdir = pos_t(0.0f, 1.0f, 0.0f); // requested direction
-		size_t length = 1;
-		size_t head = 0;
-		size_t tail = length - 1;
-		size_t bestLength = length;
-
-		std::array<part_t, MAX_LENGTH> parts;
-	};
-
-	// p, h, r
-	glm::vec3 sphericalCoords{ glm::half_pi<float>(), glm::half_pi<float>() * 0.5f, 15.0f };
+		for (uint64_t tick = 0; tick < GAME_TICKS; ++tick)
+		{
+			for (size_t i = 0; i < snakes.size(); ++i)
+			{
+				snakes[i]->setDirection(su::autopilot(*snakes[i], field, random));
+				snakes[i]->update(opponents[i]);
+			}
 
-	// x = p, y = a|h, z = r
-	glm::vec3 toCartesianCoords(const glm::vec3 &shericalCoords)
-	{
-		return {
-			shericalCoords.z * glm::sin(shericalCoords.x) * glm::cos(shericalCoords.y),
-			shericalCoords.z * glm::cos(shericalCoords.x),
-			shericalCoords.z * glm::sin(shericalCoords.x) * glm::sin(shericalCoords.y)
-		};
+			batch.clear();
+			field.draw(batch);
+			for (size_t i = 0; i < snakes.size(); ++i)
+				snakes[i]->draw(batch, su::PLAYER_PALETTES[i]);
+		}
 	}
 
-	bool isH1() // bottom
+	// A snake covering three quarters of a 16^3 arena follows the arena cycle and finds food in front of it every
+	// few ticks, so it grows and new food is spawned while the board is nearly full. It is laid out again when full.
+	void trainHighFill()
 	{
-		return sphericalCoords.y > 0.25f * glm::pi<float>() && sphericalCoords.y <= 0.75f * glm::pi<float>();
-	}
+		constexpr size_t N = 16;
+		using Cycle = Benchmark::Cycle<N, N, N>;
+		using Field = su::BasicField<N, N, N>;
+		using Snake = su::BasicSnake<N, N, N>;
+
+		std::unique_ptr<Field> field(new Field(1));
+		std::unique_ptr<Snake> snake(new Snake(*field));
+		su::CubeBatch batch(N, N, N);
+
+		// Head at cycle index headCell, the body trails behind it along the cycle
+		size_t headCell = Field::SIZE * 3 / 4 - 1;
+		for (uint64_t tick = 0; tick < HIGH_FILL_TICKS; ++tick)
+		{
+			if (tick == 0 || snake->getLength() >= Field::SIZE - 1)
+				snake->assign(Field::SIZE * 3 / 4, [&](size_t i) { return Cycle::cell(headCell + Field::SIZE - i); }, Cycle::step(headCell));
 
-	bool isH2() // left
-	{
-		return sphericalCoords.y > 0.75f * glm::pi<float>() && sphericalCoords.y <= 1.25f * glm::pi<float>();
+			if (tick % 4 == 0)
+				field->setFood(Cycle::cell(headCell + 1));
+			snake->setDirection(Cycle::step(headCell++));
+			snake->update();
+
+			batch.clear();
+			field->draw(batch);
+			snake->draw(batch);
+		}
 	}
 
-	bool isH3() // top
+	void trainGhosts()
 	{
-		return sphericalCoords.y > 1.25f * glm::pi<float>() && sphericalCoords.y <= 1.75f * glm::pi<float>();
+		su::GhostSet ghosts;
+		ghosts.generate(GHOSTS, 1);
+		for (uint64_t tick = 0; tick < GHOST_TICKS; ++tick)
+			ghosts.update();
 	}
-	// else right
 
-	void drawNum3D(size_t num, const glm::vec3 &noff, const glm::vec3 &c)
+	// Bursts of key, button, text, scroll and cursor events as a hectic player produces them. One thread pushes and
+	// flushes like the GLFW callbacks, this one drains like mainThread. The consumer is paused while a burst is pushed,
+	// as it is while a frame renders, and a burst holds more events that are never merged than the ring can take,
+	// so coalescing, the ring, the overflow list and dropping text events all run.
+	void trainEvents()
 	{
-		switch (num)
+		EventQueue queue;
+		std::atomic<size_t> pushedBursts{ 0 };  // consumer drains while pushedBursts > drainedBursts
+		std::atomic<size_t> drainedBursts{ 0 };
+		std::thread producer([&]()
 		{
-		case 0:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
+			for (size_t burst = 0; burst < EVENT_BURSTS; ++burst)
+			{
+				for (size_t i = 0; i < EVENT_BURST_SIZE; ++i)
+				{
+					Event e;
+					e.timestamp = Event::now();
+					switch (i % 8)
+					{
+					case 0:
+						e.type = Event::Type::KeyEvent;
+						e.keyEventArgs.key = GLFW_KEY_W + static_cast<int>(burst % 4);
+						e.keyEventArgs.scancode = 0;
+						e.keyEventArgs.action = (i / 8) % 2 == 0 ? GLFW_PRESS : GLFW_RELEASE;
+						e.keyEventArgs.mods = 0;
+						break;
+					case 1:
+						e.type = Event::Type::MouseButtonEvent;
+						e.mouseButtonEventArgs.button = GLFW_MOUSE_BUTTON_LEFT;
+						e.mouseButtonEventArgs.action = (i / 8) % 2 == 0 ? GLFW_PRESS : GLFW_RELEASE;
+						e.mouseButtonEventArgs.mods = 0;
+						break;
+					case 2:
+						e.type = Event::Type::CharEvent;
+						e.charEventArgs.codepoint = 'w';
+						break;
+					case 3:
+						e.type = Event::Type::CharModsEvent;
+						e.charModsEventArgs.codepoint = 'w';
+						e.charModsEventArgs.mods = 0;
+						break;
+					case 4:
+						e.type = Event::Type::MouseScrollWheelEvent;
+						e.mouseScrollWheelEventArgs.xoffset = 0.0;
+						e.mouseScrollWheelEventArgs.yoffset = 1.0;
+						break;
+					default:
+						e.type = Event::Type::CursorPositionEvent;
+						e.cursorPositionEventArgs.xpos = static_cast<double>(i);
+						e.cursorPositionEventArgs.ypos = static_cast<double>(burst % 480);
+						break;
+					}
+					queue.push(e);
+				}
+				pushedBursts.store(burst + 1, std::memory_order_release);
 
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
+				// Like glfwWaitEvents, the next burst only comes after the consumer took everything
+				queue.flush();
+				while (queue.stats().size > 0)
+				{
+					std::this_thread::yield();
+					queue.flush();
+				}
+				drainedBursts.store(burst + 1, std::memory_order_release);
+			}
+		});
 
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 1:
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
+		std::vector<Event> batch;
+		batch.reserve(EventQueue::CAPACITY);
+		size_t handled = 0;
+		while (drainedBursts.load(std::memory_order_acquire) < EVENT_BURSTS)
+		{
+			if (pushedBursts.load(std::memory_order_acquire) == drainedBursts.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+				continue;
+			}
 
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
+			queue.drain(batch);
+			handled += batch.size();
+			if (batch.empty())
+				std::this_thread::yield();
+		}
+		producer.join();
 
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 2:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 3:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 4:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
+		EventQueue::Stats stats = queue.stats();
+		std::fprintf(stderr, "Drained %u events, %u merged, %u dropped, queue peak %u\n", static_cast<unsigned int>(handled),
+			static_cast<unsigned int>(stats.coalesces), static_cast<unsigned int>(stats.drops), static_cast<unsigned int>(stats.highWaterMark));
+	}
 
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
+	// Renders the benchmark scenes into an invisible window of the GLFW null platform with an OSMesa context, so
+	// the render paths are trained without a display. Needs GLFW 3.4 and libOSMesa at runtime, otherwise it is skipped.
+	bool trainRendering()
+	{
+#ifdef GLFW_PLATFORM_NULL
+		glfwSetErrorCallback(onGlfwErrorEvent);
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+		if (glfwInit() == GLFW_FALSE)
+			return false;
+
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		GLFWwindow *window = glfwCreateWindow(RENDER_WIDTH, RENDER_HEIGHT, ApplicationSettings::NAME_STRING, nullptr, nullptr);
+		if (window == nullptr)
+		{
+			glfwTerminate();
+			return false;
+		}
 
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 5:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 6:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 7:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
+		glfwMakeContextCurrent(window);
+		if (GLExt::load(window))
+		{
+			su::VertexPulling::init();
+			su::Raymarcher::init();
+			su::GhostRenderer::init();
+		}
 
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
+		EventQueue events;
+		std::vector<RenderBenchmark::Result> results;
+		RenderBenchmark::run(window, events, static_cast<float>(RENDER_WIDTH), static_cast<float>(RENDER_HEIGHT), RENDER_FRAMES, results);
 
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 8:
-			su::drawCube({noff.x + 0.0f, noff.y + 4.0f, noff.z}, c);
-			su::drawCube({noff.x + 0.0f, noff.y + 3.0f, noff.z}, c);
-			su::drawCube({noff.x + 0.0f, noff.y + 2.0f, noff.z}, c);
-			su::drawCube({noff.x + 0.0f, noff.y + 1.0f, noff.z}, c);
-			su::drawCube({noff.x + 0.0f, noff.y + 0.0f, noff.z}, c);
-																												  
-			su::drawCube({noff.x + 1.0f, noff.y + 4.0f, noff.z}, c);
-			su::drawCube({noff.x + 1.0f, noff.y + 2.0f, noff.z}, c);
-			su::drawCube({noff.x + 1.0f, noff.y + 0.0f, noff.z}, c);
-																												  
-			su::drawCube({noff.x + 2.0f, noff.y + 4.0f, noff.z}, c);
-			su::drawCube({noff.x + 2.0f, noff.y + 3.0f, noff.z}, c);
-			su::drawCube({noff.x + 2.0f, noff.y + 2.0f, noff.z}, c);
-			su::drawCube({noff.x + 2.0f, noff.y + 1.0f, noff.z}, c);
-			su::drawCube({noff.x + 2.0f, noff.y + 0.0f, noff.z}, c);
-			break;
-		case 9:
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		}
+		glfwMakeContextCurrent(nullptr);
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return true;
+#else
+		return false;
+#endif
 	}
 
-	void drawChar3D(char cha, const glm::vec3 &noff, const glm::vec3 &c)
+	// Expects the job workers to be running
+	int run()
 	{
-		switch (cha)
+		int64_t start = Event::now();
+		auto step = [](const char *name, void (*train)())
 		{
-		case 'S':
-			drawNum3D(5, noff, c);
-			break;
-		case 'N':
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 3.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 3.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 3.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 3.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 3.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 'A':
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 'K':
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 'E':
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 0.0f, noff.z }, c);
-			break;
-		case 'D':
-			su::drawCube({ noff.x + 0.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 1.0f, noff.z }, c);
-			su::drawCube({ noff.x + 0.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 1.0f, noff.y + 4.0f, noff.z }, c);
-			su::drawCube({ noff.x + 1.0f, noff.y + 0.0f, noff.z }, c);
-
-			su::drawCube({ noff.x + 2.0f, noff.y + 3.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 2.0f, noff.z }, c);
-			su::drawCube({ noff.x + 2.0f, noff.y + 1.0f, noff.z }, c);
-			break;
-		}
+			int64_t stepStart = Event::now();
+			train();
+			std::fprintf(stderr, "Trained %s in %.2f s\n", name, (Event::now() - stepStart) * 1e-9);
+		};
+
+		step("games", trainGames);
+		step("high fill", trainHighFill);
+		step("ghosts", trainGhosts);
+		step("events", trainEvents);
+		if (!trainRendering())
+			std::fprintf(stderr, "No headless OpenGL context, rendering is not trained. Run the instrumented build with --bench-render to train it in a window.\n");
+
+		std::fprintf(stderr, "Training took %.1f s\n", (Event::now() - start) * 1e-9);
+		return 0;
 	}
 }
+#pragma endregion
 
 void mainThread(void *data)
 {
 	AppData &appData = *static_cast<AppData *>(data);
 
+	// Before anything is allocated here, see ThreadControl
+	ThreadControl::pinCurrentThread(appData.options.renderCpus);
+	Profiler::setThreadName("mainThread");
+	if (appData.options.highPriority)
+		ThreadControl::raiseCurrentThreadPriority();
+
 	glfwMakeContextCurrent(appData.window);
 
-	windowSizeCallback(appData.window, appData.width, appData.height);
+	su::RenderPath renderPath = su::RenderPath::Immediate;
+	if (GLExt::load(appData.window))
+	{
+		su::VertexPulling::init();
+		su::Raymarcher::init();
+		su::GhostRenderer::init();
+		if (su::VertexPulling::available)
+			renderPath = su::RenderPath::VertexPulling;
+	}
+
+	// F5 cycles through the requested modes, presentMode is what was applied, e.g. vsync if adaptive vsync is unsupported
+	PresentMode requestedPresentMode = appData.options.presentMode;
+	PresentMode presentMode = applyPresentMode(requestedPresentMode);
+	FrameLimiter frameLimiter;
+	frameLimiter.setRate(appData.options.fpsCap);
+
+	bool lowLatency = appData.options.lowLatency;
+	bool showOrthoViews = appData.options.orthoViews;
+	LowLatencyScheduler lowLatencyScheduler;
+	LatencyStats latencyStats;     // key press until the frame that handled it was presented
+	LatencyStats tickLatencyStats; // move until the tick that applied it was simulated
+	int64_t latencyReportTime = 0;
 
 	{
-		std::unique_lock<std::mutex> lk(appData.initializationMutex);
+		std::unique_lock<LockStats::InstrumentedMutex> lk(appData.initializationMutex);
 		appData.initializationDone = true;
 		appData.initializationCondition.notify_one();
 	}
@@ -1038,29 +5955,145 @@ void mainThread(void *data)
 	glEnable(GL_CULL_FACE);
 	glFrontFace(GL_CW);
 
+	// Only the main thread pushes events, so the initial size is read directly instead of being queued from here
+	float width = static_cast<float>(appData.width);
+	float height = static_cast<float>(appData.height);
+	glViewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+
+	// The benchmark replaces the game and closes the window when it is done
+	if (appData.options.benchRenderPath != nullptr)
+	{
+		applyPresentMode(PresentMode::Uncapped);
+
+		std::vector<RenderBenchmark::Result> results;
+		if (RenderBenchmark::run(appData.window, appData.eventQueue, width, height, appData.options.benchFrames, results))
+			RenderBenchmark::write(appData.options.benchRenderPath, results);
+
+		glfwSetWindowShouldClose(appData.window, GLFW_TRUE);
+		glfwPostEmptyEvent();
+		return;
+	}
+
 	su::Field field;
-	su::Snake snake(field);
-	snake.reset({1.0f, 1.0f, 0.0f});
+	su::CubeBatch gameBatch(su::FIELD_WIDTH, su::FIELD_HEIGHT, su::FIELD_DEPTH);
+
+	// All players live in one simulation, the snakes of the others are obstacles
+	std::vector<su::Player> players;
+	players.reserve(appData.options.players);
+	for (size_t i = 0; i < appData.options.players; ++i)
+		players.emplace_back(field, i);
+
+	std::vector<std::vector<const su::Snake *>> opponents(players.size());
+	for (size_t i = 0; i < players.size(); ++i)
+	{
+		for (size_t j = 0; j < players.size(); ++j)
+		{
+			if (i != j)
+				opponents[i].push_back(&players[j].snake);
+		}
+	}
+
+	// Scores are drawn in the colour of their snake when there are several
+	if (players.size() > 1)
+	{
+		for (su::Player &player : players)
+		{
+			player.scoreText.setPalette(su::PLAYER_PALETTES[player.index]);
+			player.bestScoreText.setPalette(su::PLAYER_PALETTES[player.index]);
+		}
+	}
+
+	su::GhostSet ghosts;
+	if (appData.options.ghosts > 0)
+	{
+		// Ghosts are drawn with vertex pulling, also when another render path is selected
+		if (su::GhostRenderer::available && su::VertexPulling::available)
+		{
+			double start = glfwGetTime();
+			ghosts.generate(appData.options.ghosts, static_cast<unsigned int>(time(0)));
+			Debug::clog("Recorded ", ghosts.size(), " ghost replays in ", (glfwGetTime() - start) * 1000.0, " ms\n");
+		}
+		else
+			Debug::clog("Ghosts need OpenGL 3.1 and are disabled.\n");
+	}
+
+	// Debug overlay lines, only shown with F3
+	su::HudText eventStatsText({ 0.0f, 1.0f }, { 0.0f, 1.0f }, { +1.0f, -1.0f }, 1.0f / 150.0f, su::PALETTE_TEXT);
+
+	// Most contended mutexes below the event stats: contended/total acquisitions, wait and hold p99 in us
+	constexpr size_t LOCK_STATS_LINES = 4;
+	std::vector<su::HudText> lockStatsTexts;
+	for (size_t i = 0; i < LOCK_STATS_LINES; ++i)
+		lockStatsTexts.emplace_back(glm::vec2(0.0f, 1.0f), glm::vec2(0.0f, 1.0f), glm::vec2(+1.0f, -1.0f - 7.0f * (i + 1)), 1.0f / 150.0f, su::PALETTE_TEXT);
+
+	su::HudText titleText({ 0.5f, 1.0f }, { 0.5f, 1.0f }, { 0.0f, -2.0f }, 1.0f / 60.0f, su::PALETTE_TEXT);
+	titleText.set("SNAKE3D");
+
+	for (su::Player &player : players)
+		player.viewport = su::splitScreenViewport(player.index, players.size(), width, height);
+
+	auto playerAt = [&](double x, double y) -> su::Player *
+	{
+		for (su::Player &player : players)
+		{
+			if (player.viewport.contains(x, y, height))
+				return &player;
+		}
+		return nullptr;
+	};
 
 	glClearColor(su::BG_R, su::BG_G, su::BG_B, 1.0f);
 
+	if (appData.options.renderStatsPath != nullptr)
+		RenderStats::openDump(appData.options.renderStatsPath, appData.options.renderStatsInterval);
+	if (appData.options.perfCountersPath != nullptr)
+		PerfCounters::open(appData.options.perfCountersPath, appData.options.renderStatsInterval);
+
+	std::vector<Event> eventBatch;
+	eventBatch.reserve(EventQueue::CAPACITY);
+
 	double lmx = 0.0, lmy = 0.0;
 
-	float width = 0.0f, height = 0.0f;
 	bool shouldClose = false;
 	bool leftMouseButtonDown = false;
+	su::Player *cameraPlayer = nullptr;
 
-	double ticker = 0.0;
-	double frameStart = 0.0;
-	double deltaTime = 0.0;
+	bool sceneChanged = true;
+	// Ticks are due on a fixed schedule of game time. Moves wait for the first tick that is due after their key press,
+	// so the tick an input lands in depends on when it happened and not on when a frame handled it.
+	constexpr int64_t TICK_PERIOD = 200000000; // ns
+	GameClock gameClock(TICK_PERIOD);
+	gameClock.setScale(appData.options.timeScale, Event::now());
+	gameClock.start(Event::now());
+
+	struct TimedMove
+	{
+		int64_t timestamp; // real time of the key press
+		int64_t gameTime;  // game time of the key press
+		size_t player;
+		glm::vec3 direction;
+	};
+	std::vector<TimedMove> pendingMoves;
+	int64_t frameIndex = 0;
+	Jobs::Counter profileExport;
 	while (!shouldClose)
 	{
+		bool vsynced = presentMode == PresentMode::VSync || presentMode == PresentMode::AdaptiveVSync;
+		if (lowLatency && vsynced)
 		{
-			std::lock_guard<std::mutex> lock(appData.mutexEventQueue);
-			for (size_t i = 0; i < appData.eventQueue.size(); ++i)
-			{
-				Event &e = appData.eventQueue[i];
+			lowLatencyScheduler.setRefreshRate(appData.refreshRate);
+			lowLatencyScheduler.waitForFrameStart();
+		}
+		EventTrace::recordMarker(EventTrace::KIND_FRAME_BEGIN, frameIndex);
+		PerfCounters::beginFrame();
 
+		int64_t keyPressTime = 0;
+		{
+			PROFILE_ZONE("event drain");
+			// All published events are taken at once, the callbacks can keep pushing while they are handled
+			appData.eventQueue.drain(eventBatch);
+			for (const Event &e : eventBatch)
+			{
 				switch (e.type)
 				{
 				case Event::Type::WindowPositionEvent:
@@ -1069,6 +6102,8 @@ void mainThread(void *data)
 					glViewport(0, 0, e.windowSizeEventArgs.width, e.windowSizeEventArgs.height);
 					width = static_cast<float>(e.windowSizeEventArgs.width);
 					height = static_cast<float>(e.windowSizeEventArgs.height);
+					for (su::Player &player : players)
+						player.viewport = su::splitScreenViewport(player.index, players.size(), width, height);
 					break;
 				case Event::Type::WindowCloseEvent:
 					shouldClose = true;
@@ -1084,95 +6119,99 @@ void mainThread(void *data)
 				case Event::Type::MouseButtonEvent:
 					if(e.mouseButtonEventArgs.button == GLFW_MOUSE_BUTTON_LEFT) {
 						leftMouseButtonDown = e.mouseButtonEventArgs.action != GLFW_RELEASE;
+						// A drag rotates the camera of the view it started in
+						cameraPlayer = leftMouseButtonDown ? playerAt(lmx, lmy) : nullptr;
 					}
 					break;
 				case Event::Type::CursorPositionEvent:
-					if (leftMouseButtonDown)
+					if (leftMouseButtonDown && cameraPlayer != nullptr)
 					{
+						glm::vec3 &sphericalCoords = cameraPlayer->sphericalCoords;
 						float dx = static_cast<float>(lmx - e.cursorPositionEventArgs.xpos);
 						float dy = static_cast<float>(lmy - e.cursorPositionEventArgs.ypos);
 
-						su::sphericalCoords.y = su::sphericalCoords.y - dx * 0.01f;
-						if (su::sphericalCoords.y >= glm::two_pi<float>())
-							su::sphericalCoords.y -= glm::two_pi<float>();
-						if(su::sphericalCoords.y < 0.0f)
-							su::sphericalCoords.y += glm::two_pi<float>();
+						sphericalCoords.y = sphericalCoords.y - dx * 0.01f;
+						if (sphericalCoords.y >= glm::two_pi<float>())
+							sphericalCoords.y -= glm::two_pi<float>();
+						if(sphericalCoords.y < 0.0f)
+							sphericalCoords.y += glm::two_pi<float>();
 
-						su::sphericalCoords.x = glm::clamp(su::sphericalCoords.x + dy * 0.01f, 0.01f, glm::pi<float>() - 0.01f);
+						sphericalCoords.x = glm::clamp(sphericalCoords.x + dy * 0.01f, 0.01f, glm::pi<float>() - 0.01f);
 					}
 					lmx = e.cursorPositionEventArgs.xpos;
 					lmy = e.cursorPositionEventArgs.ypos;
 					break;
 				case Event::Type::MouseScrollWheelEvent:
-					su::sphericalCoords.z -= su::sphericalCoords.z * e.mouseScrollWheelEventArgs.yoffset * 0.1f;
-					if (su::sphericalCoords.z > 50.0f)
-						su::sphericalCoords.z = 50.0f;
-					if (su::sphericalCoords.z < 0.1f)
-						su::sphericalCoords.z = 0.1f;
+					if (su::Player *player = playerAt(lmx, lmy))
+					{
+						glm::vec3 &sphericalCoords = player->sphericalCoords;
+						sphericalCoords.z -= sphericalCoords.z * e.mouseScrollWheelEventArgs.yoffset * 0.1f;
+						if (sphericalCoords.z > 50.0f)
+							sphericalCoords.z = 50.0f;
+						if (sphericalCoords.z < 0.1f)
+							sphericalCoords.z = 0.1f;
+					}
 					break;
 				case Event::Type::KeyEvent:
 					if (e.keyEventArgs.action == GLFW_PRESS)
 					{
+						keyPressTime = e.timestamp;
+
+						for (su::Player &player : players)
+						{
+							su::Move move = su::controlsMove(player.index, e.keyEventArgs.key);
+							// Alone, the arrow keys steer as well
+							if (move == su::MOVE_NONE && players.size() == 1)
+								move = su::controlsMove(1, e.keyEventArgs.key);
+
+							if (move != su::MOVE_NONE)
+								pendingMoves.push_back({ e.timestamp, gameClock.gameTime(e.timestamp), player.index, su::moveDirection(player.sphericalCoords, move) });
+						}
+
 						switch (e.keyEventArgs.key)
 						{
-						case GLFW_KEY_W:
-						case GLFW_KEY_UP:
-							// opposite dir
-							if(su::isH1()) // from +z
-								snake.setDirection({ +0.0f, +0.0f, -1.0f });
-							else if(su::isH2()) // from -x
-								snake.setDirection({ +1.0f, +0.0f, +0.0f });
-							else if(su::isH3()) // from -z
-								snake.setDirection({ +0.0f, +0.0f, +1.0f });
-							else // from +x
-								snake.setDirection({ -1.0f, +0.0f, +0.0f });
+						case GLFW_KEY_F4:
+							// Cycle through the render paths that could be initialized
+							do
+							{
+								renderPath = static_cast<su::RenderPath>((static_cast<int>(renderPath) + 1) % static_cast<int>(su::RenderPath::Count));
+							} while ((renderPath == su::RenderPath::VertexPulling && !su::VertexPulling::available) ||
+									 (renderPath == su::RenderPath::Raymarch && !su::Raymarcher::available));
+							Debug::clog("Render path ", static_cast<int>(renderPath), '\n');
 							break;
-						case GLFW_KEY_S:
-						case GLFW_KEY_DOWN:
-							// same dir
-							if (su::isH1()) // from +z
-								snake.setDirection({ +0.0f, +0.0f, +1.0f });
-							else if (su::isH2()) // from -x
-								snake.setDirection({ -1.0f, +0.0f, +0.0f });
-							else if (su::isH3()) // from -z
-								snake.setDirection({ +0.0f, +0.0f, -1.0f });
-							else // from +x
-								snake.setDirection({ +1.0f, +0.0f, +0.0f });
+						case GLFW_KEY_F3:
+							appData.showGameInformation = !appData.showGameInformation;
 							break;
-						case GLFW_KEY_A:
-						case GLFW_KEY_LEFT:
-							// left dir
-							if (su::isH1()) // from +z
-								snake.setDirection({ -1.0f, +0.0f, +0.0f });
-							else if (su::isH2()) // from -x
-								snake.setDirection({ +0.0f, +0.0f, -1.0f });
-							else if (su::isH3()) // from -z
-								snake.setDirection({ +1.0f, +0.0f, +0.0f });
-							else // from +x
-								snake.setDirection({ +0.0f, +0.0f, +1.0f });
+						case GLFW_KEY_F5:
+							requestedPresentMode = static_cast<PresentMode>((static_cast<int>(requestedPresentMode) + 1) % static_cast<int>(PresentMode::Count));
+							presentMode = applyPresentMode(requestedPresentMode);
+							Debug::clog("Present mode ", PRESENT_MODE_NAMES[static_cast<int>(presentMode)], '\n');
 							break;
-						case GLFW_KEY_D:
-						case GLFW_KEY_RIGHT:
-							// right dir
-							if (su::isH1()) // from +z
-								snake.setDirection({ +1.0f, +0.0f, +0.0f });
-							else if (su::isH2()) // from -x
-								snake.setDirection({ +0.0f, +0.0f, +1.0f });
-							else if(su::isH3()) // from -z
-								snake.setDirection({ -1.0f, +0.0f, +0.0f });
-							else // from +x
-								snake.setDirection({ +0.0f, +0.0f, -1.0f });
+						case GLFW_KEY_F6:
+							lowLatency = !lowLatency;
+							Debug::clog("Low latency mode ", lowLatency ? "enabled" : "disabled", '\n');
 							break;
-						case GLFW_KEY_SPACE:
-							snake.setDirection({ +0.0f, +1.0f, +0.0f });
+						case GLFW_KEY_F7:
+							showOrthoViews = !showOrthoViews;
 							break;
-						case GLFW_KEY_LEFT_SHIFT:
-							snake.setDirection({ +0.0f, -1.0f, +0.0f });
+						case GLFW_KEY_F8:
+						{
+							// Written on a worker, the frame goes on meanwhile
+							const char *path = appData.options.profilePath;
+							if (profileExport.done())
+								Jobs::run(profileExport, [path]() { Profiler::exportTrace(path); });
+						} break;
+						case GLFW_KEY_PAUSE:
+							// At the key press like moves, so where the pause falls in the tick schedule does not depend on the frame
+							if (gameClock.isPaused())
+								gameClock.resume(e.timestamp);
+							else
+								gameClock.pause(e.timestamp);
+							Debug::clog(gameClock.isPaused() ? "Paused\n" : "Resumed\n");
 							break;
-						case GLFW_KEY_F3:
-							appData.showGameInformation = !appData.showGameInformation;
 						case GLFW_KEY_F11:
-							glfwSwapInterval(1);
+							// Switching between fullscreen and windowed may reset the swap interval
+							applyPresentMode(presentMode);
 							break;
 						}
 					}
@@ -1185,7 +6224,31 @@ void mainThread(void *data)
 					break;
 				}
 			}
-			appData.eventQueue.clear();
+			appData.eventQueue.requestFlush();
+		}
+
+		// Tick right after sampling input, so the frame below already shows its effect
+		int64_t tickProcessTime = Event::now();
+		uint64_t tick;
+		while (gameClock.nextTickDue(tickProcessTime, tick))
+		{
+			PROFILE_ZONE("tick");
+			PerfCounters::Scope tickCounters(PerfCounters::SECTION_TICK);
+			int64_t tickTime = gameClock.tickTime(tick);
+			size_t applied = 0;
+			for (; applied < pendingMoves.size() && pendingMoves[applied].gameTime <= tickTime; ++applied)
+			{
+				const TimedMove &move = pendingMoves[applied];
+				players[move.player].snake.setDirection(move.direction);
+				tickLatencyStats.add((tickProcessTime - move.timestamp) * 1e-9);
+			}
+			pendingMoves.erase(pendingMoves.begin(), pendingMoves.begin() + applied);
+			EventTrace::recordMarker(EventTrace::KIND_TICK, static_cast<int64_t>(tick), gameClock.realTime(tickTime));
+
+			for (size_t i = 0; i < players.size(); ++i)
+				players[i].snake.update(opponents[i]);
+			ghosts.update();
+			sceneChanged = true;
 		}
 		
 #ifdef __APPLE__
@@ -1193,270 +6256,397 @@ void mainThread(void *data)
 		CGLContextObj cglContext = CGLGetCurrentContext();
    		CGLLockContext(cglContext);
 #endif
+		RenderStats::beginFrame();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glm::mat4 pMatGame = glm::perspective(glm::half_pi<float>() * 0.5f, width / height, 0.1f, 100.0f);
-		glm::mat4 vMatGame = glm::lookAt(su::toCartesianCoords(su::sphericalCoords), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		glm::mat4 mMatGame = glm::translate(glm::mat4(), glm::vec3{ su::FIELD_WIDTH * -0.5f, su::FIELD_HEIGHT * -0.5f, su::FIELD_DEPTH * -0.5f });
 
-		glm::mat4 vMatText = glm::lookAt(glm::vec3(0.0f, -10.0f, 40.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-		glm::mat4 vpGame = pMatGame * vMatGame;
-		glm::mat4 vpText = pMatGame * vMatText;
-
-		// Render game scene
-		glBegin(GL_TRIANGLES);
+		// Geometry of all players is uploaded once per tick and shared by every viewport
+		if (sceneChanged)
+		{
+			PROFILE_ZONE("geometry");
+			gameBatch.clear();
+			field.draw(gameBatch);
+			for (const su::Player &player : players)
+				player.snake.draw(gameBatch, su::PLAYER_PALETTES[player.index]);
+			su::Raymarcher::update(gameBatch);
+			sceneChanged = false;
+		}
 
-		su::mvp = vpGame * mMatGame;
+		// Uploads happen above, drawing the scene again only costs a draw call
+		auto drawScene = [&](float x, float y, float w, float h)
+		{
+			if (renderPath == su::RenderPath::Raymarch)
+				su::Raymarcher::draw(x, y, w, h);
+			else
+				gameBatch.draw(renderPath);
+		};
 
-		field.draw();
-		snake.draw();
+		for (const su::Player &player : players)
+		{
+			const su::Viewport &viewport = player.viewport;
+			RenderStats::viewport(viewport.x, viewport.y, viewport.width, viewport.height);
 
-		glEnd();
+			glm::mat4 pMatGame = glm::perspective(glm::half_pi<float>() * 0.5f, viewport.aspect(), 0.1f, 100.0f);
+			glm::mat4 vMatGame = glm::lookAt(su::toCartesianCoords(player.sphericalCoords), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			glm::mat4 vpGame = pMatGame * vMatGame;
 
-		// Render game scene lines
-		glBegin(GL_LINES);
+			// Render game scene
+			{
+				PROFILE_ZONE("pass scene");
+				PerfCounters::Scope passCounters(PerfCounters::SECTION_PASS_SCENE);
+				RenderStats::beginPass(RenderStats::PASS_SCENE);
+				su::mvp = vpGame * mMatGame;
+				drawScene(static_cast<float>(viewport.x), static_cast<float>(viewport.y), static_cast<float>(viewport.width), static_cast<float>(viewport.height));
+			}
 
-		// Draw borders
-		glColor4f(0.8f, 0.2f, 0.2f, 0.4f);
-		{
-			glm::vec4 v0b = su::transformPosition4({ 0.0f, 0.0f, 0.0f, 1.0f });
-			glm::vec4 v1b = su::transformPosition4({ +su::FIELD_WIDTH_F, 0.0f, 0.0f, 1.0f });
-			glm::vec4 v2b = su::transformPosition4({ +su::FIELD_WIDTH_F, 0.0f, +su::FIELD_DEPTH_F, 1.0f });
-			glm::vec4 v3b = su::transformPosition4({ 0.0f, 0.0f, +su::FIELD_DEPTH_F, 1.0f });
+			// Render ghosts over the scene, hidden by it but not by each other
+			if (ghosts.size() > 0)
+			{
+				PROFILE_ZONE("pass ghosts");
+				PerfCounters::Scope passCounters(PerfCounters::SECTION_PASS_GHOSTS);
+				RenderStats::beginPass(RenderStats::PASS_GHOSTS);
+				if (su::GhostRenderer::begin(static_cast<GLsizei>(width), static_cast<GLsizei>(height), gameBatch))
+				{
+					ghosts.draw();
+					su::GhostRenderer::end();
+				}
+			}
 
-			glm::vec4 v0t = su::transformPosition4({ 0.0f, +su::FIELD_HEIGHT_F, 0.0f, 1.0f });
-			glm::vec4 v1t = su::transformPosition4({ +su::FIELD_WIDTH_F, +su::FIELD_HEIGHT_F, 0.0f, 1.0f });
-			glm::vec4 v2t = su::transformPosition4({ +su::FIELD_WIDTH_F, +su::FIELD_HEIGHT_F, +su::FIELD_DEPTH_F, 1.0f });
-			glm::vec4 v3t = su::transformPosition4({ 0.0f, +su::FIELD_HEIGHT_F, +su::FIELD_DEPTH_F, 1.0f });
+			// Render game scene lines, the zone ends with the player
+			PROFILE_ZONE("pass lines");
+			PerfCounters::Scope passCounters(PerfCounters::SECTION_PASS_LINES);
+			RenderStats::beginPass(RenderStats::PASS_LINES);
+			RenderStats::begin(GL_LINES);
 
-			glVertex4fv(&v0b[0]);
-			glVertex4fv(&v1b[0]);
+			// Draw borders
+			su::drawFieldBorders();
 
-			glVertex4fv(&v1b[0]);
-			glVertex4fv(&v2b[0]);
+			// Draw snake direction borders
+			su::drawDirectionBorders(player.snake.getHeadPos(), su::PLAYER_PALETTES[player.index]);
 
-			glVertex4fv(&v2b[0]);
-			glVertex4fv(&v3b[0]);
+			// Draw axis
+			if (appData.showGameInformation) // only modified in this thread
+			{
+				su::mvp = vpGame;
+				glm::vec4 axis_o = su::transformPosition4({ 0.0f, 0.0f, 0.0f, 1.0f });
+				glm::vec4 axis_x = su::transformPosition4({ 1.0f, 0.0f, 0.0f, 1.0f });
+				glm::vec4 axis_y = su::transformPosition4({ 0.0f, 1.0f, 0.0f, 1.0f });
+				glm::vec4 axis_z = su::transformPosition4({ 0.0f, 0.0f, 1.0f, 1.0f });
 
-			glVertex4fv(&v3b[0]);
-			glVertex4fv(&v0b[0]);
+				RenderStats::immediate(6, 3);
 
-			glVertex4fv(&v0t[0]);
-			glVertex4fv(&v1t[0]);
+				glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
+				glVertex4fv(&axis_o[0]);
+				glVertex4fv(&axis_x[0]);
 
-			glVertex4fv(&v1t[0]);
-			glVertex4fv(&v2t[0]);
+				glColor4f(0.0f, 0.0f, 1.0f, 1.0f);
+				glVertex4fv(&axis_o[0]);
+				glVertex4fv(&axis_y[0]);
 
-			glVertex4fv(&v2t[0]);
-			glVertex4fv(&v3t[0]);
+				glColor4f(0.0f, 1.0f, 0.0f, 1.0f);
+				glVertex4fv(&axis_o[0]);
+				glVertex4fv(&axis_z[0]);
+			}
 
-			glVertex4fv(&v3t[0]);
-			glVertex4fv(&v0t[0]);
+			RenderStats::end();
 		}
 
-		// Draw snake direction borders
-		glColor4f(su::ST_R, su::ST_G, su::ST_B, 0.1f);
-		{
-			auto hp = snake.getHeadPos() + glm::vec3(su::CUBE_SIZE_H);
+		RenderStats::viewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
 
-			// x dir
+		// Render orthographic views stacked on the right side
+		if (showOrthoViews)
+		{
+			PROFILE_ZONE("pass views");
+			PerfCounters::Scope passCounters(PerfCounters::SECTION_PASS_VIEWS);
+			RenderStats::beginPass(RenderStats::PASS_VIEWS);
+			RenderStats::enable(GL_SCISSOR_TEST);
+			RenderStats::clearColor(su::ET_R, su::ET_G, su::ET_B, 1.0f);
+
+			GLsizei size = static_cast<GLsizei>(height) / 4;
+			GLsizei margin = size / 16;
+			for (size_t i = 0; i < su::ORTHO_VIEW_COUNT; ++i)
 			{
-				glm::vec4 v0b = su::transformPosition4({ 0.0f, hp.y - su::CUBE_SIZE_H, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v1b = su::transformPosition4({ +su::FIELD_WIDTH_F, hp.y - su::CUBE_SIZE_H, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v2b = su::transformPosition4({ +su::FIELD_WIDTH_F, hp.y - su::CUBE_SIZE_H, hp.z + su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v3b = su::transformPosition4({ 0.0f, hp.y - su::CUBE_SIZE_H, hp.z + su::CUBE_SIZE_H, 1.0f });
-
-				glm::vec4 v0t = su::transformPosition4({ 0.0f, hp.y + su::CUBE_SIZE_H, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v1t = su::transformPosition4({ +su::FIELD_WIDTH_F, hp.y + su::CUBE_SIZE_H, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v2t = su::transformPosition4({ +su::FIELD_WIDTH_F, hp.y + su::CUBE_SIZE_H, hp.z + su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v3t = su::transformPosition4({ 0.0f, hp.y + su::CUBE_SIZE_H, hp.z + su::CUBE_SIZE_H, 1.0f });
-
-				glVertex4fv(&v0b[0]);
-				glVertex4fv(&v1b[0]);
-
-				glVertex4fv(&v2b[0]);
-				glVertex4fv(&v3b[0]);
-
-				glVertex4fv(&v0t[0]);
-				glVertex4fv(&v1t[0]);
-
-				glVertex4fv(&v2t[0]);
-				glVertex4fv(&v3t[0]);
+				GLint x = static_cast<GLint>(width) - size - margin;
+				GLint y = static_cast<GLint>(height) - static_cast<GLint>(i + 1) * (size + margin);
+				RenderStats::viewport(x, y, size, size);
+				RenderStats::scissor(x, y, size, size);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				su::mvp = su::orthoViewProjection(su::ORTHO_VIEWS[i]) * mMatGame;
+				drawScene(static_cast<float>(x), static_cast<float>(y), static_cast<float>(size), static_cast<float>(size));
+
+				RenderStats::begin(GL_LINES);
+				su::drawFieldBorders();
+				RenderStats::end();
 			}
 
-			// y dir
-			{
-				glm::vec4 v0b = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, 0.0f, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v1b = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, 0.0f, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v2b = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, 0.0f, hp.z + su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v3b = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, 0.0f, hp.z + su::CUBE_SIZE_H, 1.0f });
-
-				glm::vec4 v0t = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, +su::FIELD_HEIGHT_F, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v1t = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, +su::FIELD_HEIGHT_F, hp.z - su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v2t = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, +su::FIELD_HEIGHT_F, hp.z + su::CUBE_SIZE_H, 1.0f });
-				glm::vec4 v3t = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, +su::FIELD_HEIGHT_F, hp.z + su::CUBE_SIZE_H, 1.0f });
-
-				glVertex4fv(&v0b[0]);
-				glVertex4fv(&v0t[0]);
+			RenderStats::clearColor(su::BG_R, su::BG_G, su::BG_B, 1.0f);
+			RenderStats::disable(GL_SCISSOR_TEST);
+			RenderStats::viewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+		}
 
-				glVertex4fv(&v1b[0]);
-				glVertex4fv(&v1t[0]);
+		// Render ui in screen space on top of everything, only changed texts are laid out again
+		{
+			PROFILE_ZONE("pass ui");
+			PerfCounters::Scope passCounters(PerfCounters::SECTION_PASS_UI);
+			RenderStats::beginPass(RenderStats::PASS_UI);
+			RenderStats::disable(GL_DEPTH_TEST);
 
-				glVertex4fv(&v2b[0]);
-				glVertex4fv(&v2t[0]);
+			su::Viewport windowViewport;
+			windowViewport.width = static_cast<GLsizei>(width);
+			windowViewport.height = static_cast<GLsizei>(height);
+			titleText.draw(windowViewport);
 
-				glVertex4fv(&v3b[0]);
-				glVertex4fv(&v3t[0]);
+			if (appData.showGameInformation)
+			{
+				EventQueue::Stats eventStats = appData.eventQueue.stats();
+				eventStatsText.set("EVENTS " + std::to_string(eventStats.size) + "/" + std::to_string(EventQueue::CAPACITY) +
+					" PEAK " + std::to_string(eventStats.highWaterMark) +
+					" DROPPED " + std::to_string(eventStats.drops) +
+					" MERGED " + std::to_string(eventStats.coalesces));
+				eventStatsText.draw(windowViewport);
+
+				std::vector<LockStats::Summary> lockStats = LockStats::summaries();
+				for (size_t i = 0; i < lockStats.size() && i < lockStatsTexts.size(); ++i)
+				{
+					lockStatsTexts[i].set(LockStats::format(lockStats[i]));
+					lockStatsTexts[i].draw(windowViewport);
+				}
 			}
 
-			// z dir
+			for (su::Player &player : players)
 			{
-				glm::vec4 v0b = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, hp.y - su::CUBE_SIZE_H, 0.0f, 1.0f });
-				glm::vec4 v1b = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, hp.y - su::CUBE_SIZE_H, 0.0f, 1.0f });
-				glm::vec4 v2b = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, hp.y - su::CUBE_SIZE_H, +su::FIELD_DEPTH_F, 1.0f });
-				glm::vec4 v3b = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, hp.y - su::CUBE_SIZE_H, +su::FIELD_DEPTH_F, 1.0f });
-
-				glm::vec4 v0t = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, hp.y + su::CUBE_SIZE_H, 0.0f, 1.0f });
-				glm::vec4 v1t = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, hp.y + su::CUBE_SIZE_H, 0.0f, 1.0f });
-				glm::vec4 v2t = su::transformPosition4({ hp.x + su::CUBE_SIZE_H, hp.y + su::CUBE_SIZE_H, +su::FIELD_DEPTH_F, 1.0f });
-				glm::vec4 v3t = su::transformPosition4({ hp.x - su::CUBE_SIZE_H, hp.y + su::CUBE_SIZE_H, +su::FIELD_DEPTH_F, 1.0f });
-
-				glVertex4fv(&v3b[0]);
-				glVertex4fv(&v0b[0]);
-
-				glVertex4fv(&v2b[0]);
-				glVertex4fv(&v1b[0]);
+				const su::Viewport &viewport = player.viewport;
+				RenderStats::viewport(viewport.x, viewport.y, viewport.width, viewport.height);
 
-				glVertex4fv(&v3t[0]);
-				glVertex4fv(&v0t[0]);
-
-				glVertex4fv(&v2t[0]);
-				glVertex4fv(&v1t[0]);
+				player.scoreText.setNumber(player.snake.getLength());
+				player.bestScoreText.setNumber(player.snake.getBestLength());
+				player.scoreText.draw(viewport);
+				player.bestScoreText.draw(viewport);
 			}
 		}
 
-		// Draw axis
-		if (appData.showGameInformation) // only modified in this thread
-		{
-			su::mvp = vpGame;
-			glm::vec4 axis_o = su::transformPosition4({ 0.0f, 0.0f, 0.0f, 1.0f });
-			glm::vec4 axis_x = su::transformPosition4({ 1.0f, 0.0f, 0.0f, 1.0f });
-			glm::vec4 axis_y = su::transformPosition4({ 0.0f, 1.0f, 0.0f, 1.0f });
-			glm::vec4 axis_z = su::transformPosition4({ 0.0f, 0.0f, 1.0f, 1.0f });
-
-			glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
-			glVertex4fv(&axis_o[0]);
-			glVertex4fv(&axis_x[0]);
+		RenderStats::viewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+		RenderStats::enable(GL_DEPTH_TEST);
+		RenderStats::endFrame();
 
-			glColor4f(0.0f, 0.0f, 1.0f, 1.0f);
-			glVertex4fv(&axis_o[0]);
-			glVertex4fv(&axis_y[0]);
+		if (lowLatency && vsynced)
+		{
+			glFinish();
+			lowLatencyScheduler.frameRendered();
+		}
 
-			glColor4f(0.0f, 1.0f, 0.0f, 1.0f);
-			glVertex4fv(&axis_o[0]);
-			glVertex4fv(&axis_z[0]);
+		{
+			PROFILE_ZONE("swap");
+			glfwSwapBuffers(appData.window);
 		}
 
-		glEnd();
+		if (lowLatency && vsynced)
+		{
+			glFinish();
+			lowLatencyScheduler.framePresented();
+		}
 
-		glClear(GL_DEPTH_BUFFER_BIT);
+#ifdef __APPLE__
+		CGLUnlockContext(cglContext);
+#endif
 
-		// Render ui
-		glBegin(GL_TRIANGLES);
+		EventTrace::recordMarker(EventTrace::KIND_FRAME_END, frameIndex++);
+		EventTrace::flush();
+		Profiler::collect();
+		PerfCounters::endFrame();
 
-		// Render title text
-		su::mvp = glm::translate(glm::mat4(), glm::vec3{ 0.0f, 0.8f, 0.0f }) * vpText;
+		int64_t presentTime = Event::now();
+		if (keyPressTime > 0)
+			latencyStats.add((presentTime - keyPressTime) * 1e-9);
+		if (presentTime - latencyReportTime >= 1000000000)
+		{
+			latencyStats.report(lowLatency ? "Low latency input to photon" : "Regular input to photon");
+			tickLatencyStats.report("Input to tick");
+			latencyStats = LatencyStats();
+			tickLatencyStats = LatencyStats();
+			latencyReportTime = presentTime;
+		}
 
-		glm::vec3 titleColor{ su::ST_R, su::ST_G, su::ST_B };
-		su::drawChar3D('S', { 0.0f - 12.5f, -2.0f, 0.0f }, titleColor);
-		su::drawChar3D('N', { 4.0f - 12.5f, -2.0f, 0.0f }, titleColor);
-		su::drawChar3D('A', { 9.0f - 12.5f, -2.0f, 0.0f }, titleColor);
-		su::drawChar3D('K', { 13.0f - 12.5f, -2.0f, 0.0f }, titleColor);
-		su::drawChar3D('E', { 17.0f - 12.5f, -2.0f, 0.0f }, titleColor);
-		su::drawNum3D(3, { 21.0f - 12.5f, -2.0f, 0.0f }, titleColor);
-		su::drawChar3D('D', { 25.0f - 12.5f, -2.0f, 0.0f }, titleColor);
+		if (presentMode == PresentMode::Capped)
+			frameLimiter.wait();
+	}
 
-		// Render score num
-		su::mvp = glm::translate(glm::mat4(), glm::vec3{ -0.9f, -0.9f, 0.0f }) * vpText;
+	Jobs::wait(profileExport);
+	if (appData.options.profileOnExit)
+		Profiler::exportTrace(appData.options.profilePath);
+	RenderStats::closeDump();
+	PerfCounters::close();
+}
 
-		glm::vec3 scoreColor{ su::ST_R, su::ST_G, su::ST_B };
-		// Get length digit count
+bool parseLaunchOptions(int argc, char **argv, LaunchOptions &options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--render-stats" && hasValue)
+			options.renderStatsPath = argv[++i];
+		else if (arg == "--perf-counters" && hasValue)
+			options.perfCountersPath = argv[++i];
+		else if (arg == "--pgo-train")
+			options.pgoTrain = true;
+		else if (arg == "--bench-render" && hasValue)
+			options.benchRenderPath = argv[++i];
+		else if (arg == "--bench-frames" && hasValue)
 		{
-			size_t digitNum = 0;
-			size_t dnum = snake.getLength();
-			while (dnum != 0)
+			int frames = std::atoi(argv[++i]);
+			if (frames < 1)
 			{
-				dnum /= 10;
-				++digitNum;
+				std::fprintf(stderr, "The benchmark needs at least 1 frame.\n");
+				return false;
 			}
-
-			// Draw score
-			size_t i = digitNum - 1;
-			dnum = snake.getLength();
-			while (dnum != 0)
+			options.benchFrames = static_cast<size_t>(frames);
+		}
+		else if (arg == "--render-stats-interval" && hasValue)
+		{
+			options.renderStatsInterval = std::atof(argv[++i]);
+			if (!(options.renderStatsInterval > 0.0)) // also rejects nan
 			{
-				size_t digit = dnum % 10;
-				dnum /= 10;
-				su::drawNum3D(digit, { i * 4, 0.0f, 0.0f }, scoreColor);
-				--i;
+				std::fprintf(stderr, "The render stats interval has to be a positive number of seconds.\n");
+				return false;
 			}
 		}
-
-		// Render highscore num
-		su::mvp = glm::translate(glm::mat4(), glm::vec3{ +0.8f, -0.9f, 0.0f }) * vpText;
-
-		// Get best length digit count
+		else if (arg == "--profile" && hasValue)
+		{
+			options.profilePath = argv[++i];
+			options.profileOnExit = true;
+		}
+		else if (arg == "--trace" && hasValue)
+			options.tracePath = argv[++i];
+		else if (arg == "--convert-trace" && i + 2 < argc)
+		{
+			options.convertTracePath = argv[++i];
+			options.convertJsonPath = argv[++i];
+		}
+		else if (arg == "--low-latency")
+			options.lowLatency = true;
+		else if (arg == "--views")
+			options.orthoViews = true;
+		else if (arg == "--present" && hasValue)
 		{
-			size_t bdigitNum = 0;
-			size_t bdnum = snake.getBestLength();
-			while (bdnum != 0)
+			std::string mode = argv[++i];
+			int m = 0;
+			while (m < static_cast<int>(PresentMode::Count) && mode != PRESENT_MODE_NAMES[m])
+				++m;
+			if (m == static_cast<int>(PresentMode::Count))
 			{
-				bdnum /= 10;
-				++bdigitNum;
+				std::fprintf(stderr, "Unknown present mode %s.\n", mode.c_str());
+				return false;
 			}
-
-			// Draw best score
-			size_t i = bdigitNum - 1;
-			bdnum = snake.getBestLength();
-			while (bdnum != 0)
+			options.presentMode = static_cast<PresentMode>(m);
+		}
+		else if (arg == "--players" && hasValue)
+		{
+			int players = std::atoi(argv[++i]);
+			if (players < 1 || players > static_cast<int>(su::MAX_PLAYERS))
 			{
-				size_t digit = bdnum % 10;
-				bdnum /= 10;
-				su::drawNum3D(digit, { i * 4.0f - bdigitNum * 4.0f + 4.0f, 0.0f, 0.0f }, scoreColor);
-				--i;
+				std::fprintf(stderr, "The player count has to be between 1 and %u.\n", static_cast<unsigned int>(su::MAX_PLAYERS));
+				return false;
 			}
+			options.players = static_cast<size_t>(players);
 		}
-
-		glEnd();
-		
-		glfwSwapBuffers(appData.window);
-
-#ifdef __APPLE__
-		CGLUnlockContext(cglContext);
-#endif
-
-		double currTime = glfwGetTime();
-		deltaTime = currTime - frameStart;
-		frameStart = currTime;
-		//Debug::clog(1.0 / deltaTime, '\n');
-
-		ticker += deltaTime;
-		while(ticker >= 0.2)
+		else if (arg == "--ghosts" && hasValue)
 		{
-			ticker -= 0.2;
-			snake.update();
+			int ghosts = std::atoi(argv[++i]);
+			if (ghosts < 0)
+			{
+				std::fprintf(stderr, "The ghost count can not be negative.\n");
+				return false;
+			}
+			options.ghosts = static_cast<size_t>(ghosts);
+		}
+		else if (arg == "--workers" && hasValue)
+		{
+			int workers = std::atoi(argv[++i]);
+			if (workers < 0)
+			{
+				std::fprintf(stderr, "The worker count can not be negative.\n");
+				return false;
+			}
+			options.workers = static_cast<size_t>(workers);
+		}
+		else if ((arg == "--pin-workers" || arg == "--pin-render") && hasValue)
+		{
+			std::vector<int> &cpus = arg == "--pin-workers" ? options.workerCpus : options.renderCpus;
+			if (!ThreadControl::parseCpuList(argv[++i], cpus))
+			{
+				std::fprintf(stderr, "Invalid cpu list %s, expected something like 0,2,4-7.\n", argv[i]);
+				return false;
+			}
+		}
+		else if (arg == "--time-scale" && hasValue)
+		{
+			options.timeScale = std::atof(argv[++i]);
+			if (!(options.timeScale >= GameClock::MIN_SCALE && options.timeScale <= GameClock::MAX_SCALE))
+			{
+				std::fprintf(stderr, "The time scale has to be between %g and %g.\n", GameClock::MIN_SCALE, GameClock::MAX_SCALE);
+				return false;
+			}
+		}
+		else if (arg == "--high-priority")
+			options.highPriority = true;
+		else if (arg == "--fps-cap" && hasValue)
+		{
+			options.fpsCap = std::atof(argv[++i]);
+			options.presentMode = PresentMode::Capped;
+			if (options.fpsCap <= 0.0)
+			{
+				std::fprintf(stderr, "The fps cap has to be positive.\n");
+				return false;
+			}
+		}
+		else
+		{
+			std::fprintf(stderr, "Unknown or incomplete option %s.\n", arg.c_str());
+			return false;
 		}
 	}
+	return true;
 }
 
-int main()
+int main(int argc, char **argv)
 {
-	AppData appData;
+#ifdef SNAKE3D_BENCHMARK
+	return Benchmark::run(argc, argv);
+#endif
+
+	LaunchOptions options;
+	if (!parseLaunchOptions(argc, argv, options))
+		return 1;
+
+	// Offline tool, no window needed
+	if (options.convertTracePath != nullptr)
+		return EventTrace::convert(options.convertTracePath, options.convertJsonPath) ? 0 : 1;
+
+	Jobs::init(options.workers, options.workerCpus);
+
+	// Headless, the window is only created for the game
+	if (options.pgoTrain)
+	{
+		int result = PgoTraining::run();
+		Jobs::shutdown();
+		return result;
+	}
+
+	if (options.tracePath != nullptr && !EventTrace::open(options.tracePath))
+	{
+		Jobs::shutdown();
+		return 1;
+	}
+
+	AppData appData(options);
 
 	std::thread thread(&mainThread, &appData);
 	{
-		std::unique_lock<std::mutex> lk(appData.initializationMutex);
+		std::unique_lock<LockStats::InstrumentedMutex> lk(appData.initializationMutex);
 		while (!appData.initializationDone)
 		{
 			Debug::clog("Waiting for initialization...\n");
@@ -1469,13 +6659,47 @@ int main()
 	}
 
 	while (!glfwWindowShouldClose(appData.window))
+	{
 		glfwWaitEvents();
+		appData.eventQueue.flush();
+		EventTrace::flush();
+	}
 
 	thread.join();
+	EventTrace::close();
+	Jobs::shutdown();
+	LockStats::report();
 
 	return 0;
 }
 
+int windowRefreshRate(GLFWwindow *window)
+{
+	int wx, wy, ww, wh;
+	glfwGetWindowPos(window, &wx, &wy);
+	glfwGetWindowSize(window, &ww, &wh);
+
+	int count = 0;
+	GLFWmonitor **monitors = glfwGetMonitors(&count);
+	GLFWmonitor *best = glfwGetPrimaryMonitor();
+	long bestOverlap = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const GLFWvidmode *mode = glfwGetVideoMode(monitors[i]);
+		int mx, my;
+		glfwGetMonitorPos(monitors[i], &mx, &my);
+
+		long overlapWidth = std::max(0, std::min(wx + ww, mx + mode->width) - std::max(wx, mx));
+		long overlapHeight = std::max(0, std::min(wy + wh, my + mode->height) - std::max(wy, my));
+		if (overlapWidth * overlapHeight > bestOverlap)
+		{
+			bestOverlap = overlapWidth * overlapHeight;
+			best = monitors[i];
+		}
+	}
+	return glfwGetVideoMode(best)->refreshRate;
+}
+
 void onGlfwErrorEvent(int error, const char *description)
 {
 	Debug::cerr("Error ", error, ": ", description, '\n');
@@ -1487,20 +6711,13 @@ void windowPositionCallback(GLFWwindow *window, int xpos, int ypos)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 	Event e;
 	e.type = Event::Type::WindowPositionEvent;
+	e.timestamp = Event::now();
 	e.windowPositionEventArgs.xpos = xpos;
 	e.windowPositionEventArgs.ypos = ypos;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-
-	for (size_t i = 0; i < appData->eventQueue.size(); ++i)
-	{
-		if (appData->eventQueue[i].type == Event::Type::WindowPositionEvent)
-		{
-			appData->eventQueue[i] = e;
-			return;
-		}
-	}
+	appData->eventQueue.push(e);
 
-	appData->eventQueue.push_back(e);
+	// The vblank deadline of the low latency mode follows the window to other monitors
+	appData->refreshRate = windowRefreshRate(window);
 }
 
 void windowSizeCallback(GLFWwindow *window, int width, int height)
@@ -1509,23 +6726,12 @@ void windowSizeCallback(GLFWwindow *window, int width, int height)
 
 	Event e;
 	e.type = Event::Type::WindowSizeEvent;
+	e.timestamp = Event::now();
 	e.windowSizeEventArgs.width = width;
 	e.windowSizeEventArgs.height = height;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-
 	appData->width = width;
 	appData->height = height;
-
-	for (size_t i = 0; i < appData->eventQueue.size(); ++i)
-	{
-		if (appData->eventQueue[i].type == Event::Type::WindowSizeEvent)
-		{
-			appData->eventQueue[i] = e;
-			return;
-		}
-	}
-
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void windowCloseCallback(GLFWwindow *window)
@@ -1534,8 +6740,8 @@ void windowCloseCallback(GLFWwindow *window)
 
 	Event e;
 	e.type = Event::Type::WindowCloseEvent;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	e.timestamp = Event::now();
+	appData->eventQueue.push(e);
 }
 
 void windowRefreshCallback(GLFWwindow *window)
@@ -1544,8 +6750,8 @@ void windowRefreshCallback(GLFWwindow *window)
 
 	Event e;
 	e.type = Event::Type::WindowRefreshEvent;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	e.timestamp = Event::now();
+	appData->eventQueue.push(e);
 }
 
 void windowFocusCallback(GLFWwindow *window, int focused)
@@ -1553,9 +6759,9 @@ void windowFocusCallback(GLFWwindow *window, int focused)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 	Event e;
 	e.type = Event::Type::WindowFocusEvent;
+	e.timestamp = Event::now();
 	e.windowFocusEventArgs.focused = focused == GLFW_TRUE;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void windowIconifyCallback(GLFWwindow *window, int minimized)
@@ -1563,9 +6769,9 @@ void windowIconifyCallback(GLFWwindow *window, int minimized)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 	Event e;
 	e.type = Event::Type::WindowIconifyEvent;
+	e.timestamp = Event::now();
 	e.windowIconifyEventArgs.iconified = minimized == GLFW_TRUE;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void framebufferSizeCallback(GLFWwindow *window, int width, int height)
@@ -1573,10 +6779,10 @@ void framebufferSizeCallback(GLFWwindow *window, int width, int height)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 	Event e;
 	e.type = Event::Type::FramebufferSizeEvent;
+	e.timestamp = Event::now();
 	e.framebufferSizeEventArgs.width = width;
 	e.framebufferSizeEventArgs.height = height;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 // Input Events
@@ -1585,11 +6791,11 @@ void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 	Event e;
 	e.type = Event::Type::MouseButtonEvent;
+	e.timestamp = Event::now();
 	e.mouseButtonEventArgs.button = button;
 	e.mouseButtonEventArgs.action = action;
 	e.mouseButtonEventArgs.mods = mods;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void cursorPositionCallback(GLFWwindow *window, double xpos, double ypos)
@@ -1598,10 +6804,10 @@ void cursorPositionCallback(GLFWwindow *window, double xpos, double ypos)
 
 	Event e;
 	e.type = Event::Type::CursorPositionEvent;
+	e.timestamp = Event::now();
 	e.cursorPositionEventArgs.xpos = xpos;
 	e.cursorPositionEventArgs.ypos = ypos;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void cursorEnterCallback(GLFWwindow *window, int entered)
@@ -1609,10 +6815,10 @@ void cursorEnterCallback(GLFWwindow *window, int entered)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 
 	Event e;
-	e.type = Event::Type::CursorPositionEvent;
+	e.type = Event::Type::CursorEnterEvent;
+	e.timestamp = Event::now();
 	e.cursorEnterEventArgs.entered = entered == GLFW_TRUE;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void scrollCallback(GLFWwindow *window, double xoffset, double yoffset)
@@ -1620,10 +6826,10 @@ void scrollCallback(GLFWwindow *window, double xoffset, double yoffset)
 	AppData *appData = static_cast<AppData *>(glfwGetWindowUserPointer(window));
 	Event e;
 	e.type = Event::Type::MouseScrollWheelEvent;
+	e.timestamp = Event::now();
 	e.mouseScrollWheelEventArgs.xoffset = xoffset;
 	e.mouseScrollWheelEventArgs.yoffset = yoffset;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
@@ -1633,12 +6839,12 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
 	{
 		Event e;
 		e.type = Event::Type::KeyEvent;
+		e.timestamp = Event::now();
 		e.keyEventArgs.key = key;
 		e.keyEventArgs.scancode = scancode;
 		e.keyEventArgs.action = action;
 		e.keyEventArgs.mods = mods;
-		std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-		appData->eventQueue.push_back(e);
+		appData->eventQueue.push(e);
 	}
 
 	if (action == GLFW_PRESS)
@@ -1660,6 +6866,7 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
 				appData->fullscreen = true;
 				glfwSetWindowMonitor(appData->window, pmon, 0, 0, vmod->width, vmod->height, vmod->refreshRate);
 			}
+			appData->refreshRate = vmod->refreshRate;
 		} break;
 		}
 	}
@@ -1671,9 +6878,9 @@ void charCallback(GLFWwindow *window, unsigned int codepoint)
 
 	Event e;
 	e.type = Event::Type::CharEvent;
+	e.timestamp = Event::now();
 	e.charEventArgs.codepoint = codepoint;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
 
 void charModsCallback(GLFWwindow *window, unsigned int codepoint, int mods)
@@ -1682,8 +6889,8 @@ void charModsCallback(GLFWwindow *window, unsigned int codepoint, int mods)
 
 	Event e;
 	e.type = Event::Type::CharModsEvent;
+	e.timestamp = Event::now();
 	e.charModsEventArgs.codepoint = codepoint;
 	e.charModsEventArgs.mods = mods;
-	std::lock_guard<std::mutex> lock(appData->mutexEventQueue);
-	appData->eventQueue.push_back(e);
+	appData->eventQueue.push(e);
 }
\ No newline at end of file